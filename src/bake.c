@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <errno.h>
+
+#define BAKE_VERSION 1
+
+// Raw ARGB8888 pixels follow the header, the cache never leaves this machine.
+typedef struct _Bake_Header
+{
+    char   magic[4];
+    Uint32 version;
+    Uint32 width;
+    Uint32 height;
+    Uint64 key;
+} Bake_Header;
+
+const char *bakeCacheDir = NULL;
+
+static Uint64 bakeKey = 0;
+static bool   bakePending = false;     // a miss, save the first complete frame.
+
+
+static Uint64 bake_hash(Uint64 hash, const void *data, size_t length)
+{   // FNV-1a, 64 bit.
+    const Uint8 *bytes = (const Uint8*)data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+static Uint64 bake_hash_string(Uint64 hash, const char *text)
+{   // Include the terminator, so "ab","c" and "a","bc" differ.
+    return bake_hash(hash, text, strlen(text) + 1);
+}
+
+
+static Uint64 bake_hash_file(Uint64 hash, const char *path)
+{
+    struct stat info;
+
+    if (stat(path, &info) != 0)
+        return bake_hash_string(hash, "missing");
+
+    Sint64 fields[4] = {info.st_dev, info.st_ino, info.st_size, info.st_mtime};
+
+    return bake_hash(hash, fields, sizeof(fields));
+}
+
+
+static Uint64 bake_compute_key(const Ini_Program *program, int width, int height)
+{   // Dry run: only variables are set, everything else is just resolved and hashed.
+    Uint64 hash = 14695981039346656037ull;
+    int header[3] = {BAKE_VERSION, width, height};
+    SDL_RendererInfo info;
+
+    hash = bake_hash(hash, header, sizeof(header));
+
+    if (SDL_GetRendererInfo(renderer, &info) == 0)
+        hash = bake_hash_string(hash, info.name);
+
+    push_vars();
+
+    for (int i = 0; i < program->count; i++)
+    {
+        const Ini_Instr *instr = &program->instrs[i];
+
+        hash = bake_hash(hash, &instr->op, sizeof(instr->op));
+
+        if ((instr->op == INI_SET || instr->op == INI_SET_STRICT) && instr->name != NULL)
+            ini_exec(instr);
+
+        if (instr->tmpl == NULL)
+        {
+            hash = bake_hash_string(hash, instr->value);
+            continue;
+        }
+
+        char *ref = template_eval(instr->tmpl);
+
+        hash = bake_hash_string(hash, ref);
+
+        switch (instr->op)
+        {
+        case INI_IMAGE:
+        case INI_IMAGE_FALLBACK:
+        case INI_FONT:
+        case INI_FONT_FALLBACK:
+            hash = bake_hash_file(hash, ref);
+            break;
+        }
+
+        free(ref);
+    }
+
+    pop_vars();
+
+    return hash;
+}
+
+
+static void bake_path(char *path, size_t size, Uint64 key)
+{
+    snprintf(path, size, "%s/%016llx.frame", bakeCacheDir, (unsigned long long)key);
+}
+
+
+bool bake_restore(const Ini_Program *program)
+{   // Returns true if the finished frame was found and added to the scene.
+    int width, height;
+
+    if (SDL_GetRendererOutputSize(renderer, &width, &height) != 0)
+        return false;
+
+    bakeKey = bake_compute_key(program, width, height);
+    bakePending = true;
+
+    char path[4096];
+    bake_path(path, sizeof(path), bakeKey);
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "bake_cache: miss %s\n", path);
+        return false;
+    }
+
+    Bake_Header header;
+    size_t pixelBytes = (size_t)width * height * 4;
+    void *pixels = NULL;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, "SIBK", 4) != 0 ||
+        header.version != BAKE_VERSION ||
+        header.width != (Uint32)width ||
+        header.height != (Uint32)height ||
+        header.key != bakeKey)
+    {
+        fprintf(stderr, "bake_cache: %s: stale or corrupt, rebuilding.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    pixels = ez_malloc(pixelBytes);
+
+    if (fread(pixels, pixelBytes, 1, file) != 1)
+    {
+        fprintf(stderr, "bake_cache: %s: truncated, rebuilding.\n", path);
+        free(pixels);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+
+    Texture_Entry *entry = NULL;
+
+    if (cpuCompositor)
+    {   // The compositor copies it straight from a surface.
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+
+        if (surface == NULL)
+        {
+            fprintf(stderr, "SDL_CreateRGBSurfaceWithFormat Error: %s\n", SDL_GetError());
+            free(pixels);
+            return false;
+        }
+
+        for (int y = 0; y < height; y++)
+            memcpy((Uint8*)surface->pixels + y * surface->pitch, (Uint8*)pixels + (size_t)y * width * 4, width * 4);
+
+        free(pixels);
+
+        entry = texture_create_surface(surface);
+        entry->opaque = true;
+    }
+    else
+    {
+        SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STATIC, width, height);
+
+        if (texture == NULL)
+        {
+            fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+            free(pixels);
+            return false;
+        }
+
+        SDL_UpdateTexture(texture, NULL, pixels, width * 4);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+        free(pixels);
+
+        entry = texture_create(texture);
+    }
+
+    Image_Object *image = image_create();
+
+    image->texture = entry;
+    image->imageRect.w = screenWidth;
+    image->imageRect.h = screenHeight;
+
+    bakePending = false;
+
+    fprintf(stderr, "bake_cache: hit %s\n", path);
+    return true;
+}
+
+
+void bake_capture()
+{   // Call with the finished frame drawn, but before it is presented.
+    if (!bakePending)
+        return;
+
+    bakePending = false;
+
+    int width, height;
+
+    if (SDL_GetRendererOutputSize(renderer, &width, &height) != 0)
+        return;
+
+    size_t pixelBytes = (size_t)width * height * 4;
+    void *pixels = ez_malloc(pixelBytes);
+
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels, width * 4) != 0)
+    {
+        fprintf(stderr, "SDL_RenderReadPixels Error: %s\n", SDL_GetError());
+        free(pixels);
+        return;
+    }
+
+    if (mkdir(bakeCacheDir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "bake_cache: %s: %s\n", bakeCacheDir, strerror(errno));
+        free(pixels);
+        return;
+    }
+
+    Bake_Header header;
+    memset(&header, '\0', sizeof(header));
+    memcpy(header.magic, "SIBK", 4);
+    header.version = BAKE_VERSION;
+    header.width   = width;
+    header.height  = height;
+    header.key     = bakeKey;
+
+    char path[4096];
+    char tempPath[4096 + 32];
+
+    bake_path(path, sizeof(path), bakeKey);
+    snprintf(tempPath, sizeof(tempPath), "%s.%d.tmp", path, (int)getpid());
+
+    // Write it to the side and rename it in, so a reader never sees half a frame.
+    FILE *file = fopen(tempPath, "wb");
+    bool written = (file != NULL &&
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(pixels, pixelBytes, 1, file) == 1);
+
+    if (file != NULL && fclose(file) != 0)
+        written = false;
+
+    if (written && rename(tempPath, path) == 0)
+    {
+        fprintf(stderr, "bake_cache: stored %s\n", path);
+    }
+    else
+    {
+        fprintf(stderr, "bake_cache: couldn't write %s: %s\n", path, strerror(errno));
+        remove(tempPath);
+    }
+
+    free(pixels);
+}
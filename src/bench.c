@@ -0,0 +1,739 @@
+// SPDX-License-Identifier: MIT
+
+// sdl2imgshow_bench: runs sdl2imgshow headless against generated option files and
+// reports time to first present, peak RSS and navigation latency as JSON. It also times
+// the CPU compositor against SDL's software renderer at a few window sizes, and scene
+// building and drawing with thousands of layers. {{var}} substitution is timed in-process,
+// against util.c's template code.
+//
+//   sdl2imgshow_bench [--binary <sdl2imgshow>] [--font <font.ttf>] [--out <results.json>]
+//                     [--work <dir>] [--images <n>] [--lines <n>] [--nav <n>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "sdl2imgshow.h"
+
+#define BENCH_IMAGE_POOL  8         // distinct image files, options share them like real box art does.
+#define BENCH_TIMEOUT     120       // seconds before a run is considered hung.
+#define BENCH_MAX_NAV     4096
+#define BENCH_LAYER_OPTIONS 16      // options in the layer count runs, each one builds every layer.
+#define BENCH_TEMPLATE_EVALS 100000
+
+// util.c lays images out against the screen, nothing here does.
+int screenWidth  = 0;
+int screenHeight = 0;
+
+typedef struct _Bench_Result
+{
+    bool   ok;
+    double firstPresentMs;          // from the start of main, taken from the trace.
+    double wallMs;                  // fork to exit.
+    long   peakRssKb;
+    int    navCount;
+    double navMeanMs;
+    double navP50Ms;
+    double navMaxMs;
+    int    loadCount;               // option_load spans, one per option built.
+    double loadMeanMs;
+    int    drawCount;               // display_list_draw spans, one per frame drawn.
+    double drawMeanMs;
+} Bench_Result;
+
+static const char *benchBinary = NULL;
+static const char *benchFont   = NULL;
+static const char *benchOut    = "sdl2imgshow_bench.json";
+static const char *benchWork   = NULL;
+static int benchImages = 3;
+static int benchLines  = 2;
+static int benchNav    = 20;
+
+static const char *defaultFonts[] = {
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/TTF/DejaVuSans.ttf",
+    "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+};
+
+
+static double now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+static bool bench_images(const char *dir, const char *name, int width, int height)
+{   // Gradients, different per file so nothing dedupes.
+    for (int i = 0; i < BENCH_IMAGE_POOL; i++)
+    {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s%d.png", dir, name, i);
+
+        if (access(path, R_OK) == 0)
+            continue;
+
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+
+        if (surface == NULL)
+            return false;
+
+        for (int y = 0; y < surface->h; y++)
+        {
+            Uint32 *row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+
+            for (int x = 0; x < surface->w; x++)
+                row[x] = 0xff000000u | ((x * 255 / surface->w) << 16) | ((y * 255 / surface->h) << 8) | (i * 31);
+        }
+
+        int result = IMG_SavePNG(surface, path);
+        SDL_FreeSurface(surface);
+
+        if (result != 0)
+        {
+            fprintf(stderr, "bench: couldn't write %s: %s\n", path, IMG_GetError());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool bench_configs(const char *dir, int options)
+{
+    char path[4096];
+    FILE *file;
+
+    // The template draws benchImages images and benchLines lines of text per option.
+    snprintf(path, sizeof(path), "%s/template.ini", dir);
+    file = fopen(path, "w");
+
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "image_stretch=fit\n");
+
+    for (int i = 0; i < benchImages; i++)
+        fprintf(file, "image={{image%d}}\n", i);
+
+    if (benchFont != NULL)
+    {
+        fprintf(file, "font=%s\nfont_size=24\n", benchFont);
+
+        for (int i = 0; i < benchLines; i++)
+            fprintf(file, "text=Line %d of {{title}}\n", i);
+    }
+
+    fclose(file);
+
+    snprintf(path, sizeof(path), "%s/options%d.ini", dir, options);
+    file = fopen(path, "w");
+
+    if (file == NULL)
+        return false;
+
+    for (int i = 0; i < options; i++)
+    {
+        fprintf(file, "game%04d=title=Game number %d", i, i);
+
+        for (int j = 0; j < benchImages; j++)
+            fprintf(file, ";;image%d=%s/image%d.png", j, dir, (i + j) % BENCH_IMAGE_POOL);
+
+        fputc('\n', file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+static bool bench_layer_configs(const char *dir, int layers)
+{   // Every option stacks the same number of small images. Which tile a layer uses moves
+    // along by one per option, so stepping to the next option changes every layer.
+    char path[4096];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/template.ini", dir);
+    file = fopen(path, "w");
+
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "image_stretch=original\n");
+
+    for (int i = 0; i < layers; i++)
+        fprintf(file, "image={{tile%d}}\n", i % BENCH_IMAGE_POOL);
+
+    fclose(file);
+
+    snprintf(path, sizeof(path), "%s/options%d.ini", dir, BENCH_LAYER_OPTIONS);
+    file = fopen(path, "w");
+
+    if (file == NULL)
+        return false;
+
+    for (int i = 0; i < BENCH_LAYER_OPTIONS; i++)
+    {
+        fprintf(file, "game%04d=title=Game number %d", i, i);
+
+        for (int j = 0; j < BENCH_IMAGE_POOL; j++)
+            fprintf(file, ";;tile%d=%s/tile%d.png", j, dir, (i + j) % BENCH_IMAGE_POOL);
+
+        fputc('\n', file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+
+    return (da > db) - (da < db);
+}
+
+
+static void bench_parse_trace(const char *path, Bench_Result *result)
+{   // sdl2imgshow writes one event per line, so this doesn't need a JSON parser.
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return;
+
+    static double navigations[BENCH_MAX_NAV];
+    double navStart = -1;
+    double loadStart = -1, loadTotal = 0;
+    double drawStart = -1, drawTotal = 0;
+    char line[8192];
+
+    result->firstPresentMs = -1;
+    result->navCount = 0;
+    result->loadCount = 0;
+    result->drawCount = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[64];
+        char phase;
+        double ts;
+
+        if (sscanf(line, "{\"name\":\"%63[^\"]\",\"ph\":\"%c\",\"ts\":%lf", name, &phase, &ts) != 3)
+            continue;
+
+        if (strcmp(name, "first_present") == 0 && phase == 'E')
+            result->firstPresentMs = ts / 1000.0;
+
+        if (strcmp(name, "navigate") == 0)
+        {
+            if (phase == 'B')
+                navStart = ts;
+            else if (navStart >= 0 && result->navCount < BENCH_MAX_NAV)
+                navigations[result->navCount++] = (ts - navStart) / 1000.0;
+        }
+
+        // Both only happen on the main thread, so they never overlap themselves.
+        if (strcmp(name, "option_load") == 0)
+        {
+            if (phase == 'B')
+            {
+                loadStart = ts;
+            }
+            else if (loadStart >= 0)
+            {
+                loadTotal += (ts - loadStart) / 1000.0;
+                result->loadCount++;
+            }
+        }
+
+        if (strcmp(name, "display_list_draw") == 0)
+        {
+            if (phase == 'B')
+            {
+                drawStart = ts;
+            }
+            else if (drawStart >= 0)
+            {
+                drawTotal += (ts - drawStart) / 1000.0;
+                result->drawCount++;
+            }
+        }
+    }
+
+    fclose(file);
+
+    if (result->loadCount > 0)
+        result->loadMeanMs = loadTotal / result->loadCount;
+
+    if (result->drawCount > 0)
+        result->drawMeanMs = drawTotal / result->drawCount;
+
+    if (result->navCount == 0)
+        return;
+
+    double total = 0;
+
+    for (int i = 0; i < result->navCount; i++)
+        total += navigations[i];
+
+    qsort(navigations, result->navCount, sizeof(double), &compare_double);
+
+    result->navMeanMs = total / result->navCount;
+    result->navP50Ms  = navigations[result->navCount / 2];
+    result->navMaxMs  = navigations[result->navCount - 1];
+}
+
+
+static Bench_Result bench_run(const char *dir, int options, bool lazy, const char *size, bool sdlRenderer)
+{   // size is NULL for the dummy driver's own resolution, sdlRenderer draws with SDL's renderer, not the compositor.
+    Bench_Result result;
+    memset(&result, '\0', sizeof(result));
+
+    char optionFile[4096], templateFile[4096], traceFile[4096], navCount[16];
+
+    snprintf(optionFile, sizeof(optionFile), "%s/options%d.ini", dir, options);
+    snprintf(templateFile, sizeof(templateFile), "%s/template.ini", dir);
+    snprintf(traceFile, sizeof(traceFile), "%s/trace%d%s%s%s%s.json", dir, options, lazy ? "_lazy" : "",
+        (size != NULL) ? "_" : "", (size != NULL) ? size : "", sdlRenderer ? "_renderer" : "");
+    snprintf(navCount, sizeof(navCount), "%d", benchNav);
+
+    double start = now_ms();
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        fprintf(stderr, "bench: fork: %s\n", strerror(errno));
+        return result;
+    }
+
+    if (pid == 0)
+    {   // No display needed, SDL's dummy driver with the software renderer.
+        setenv("SDL_VIDEODRIVER", "dummy", 1);
+        setenv("SDL_RENDER_DRIVER", "software", 1);
+
+        if (freopen("/dev/null", "w", stderr) == NULL)
+            _exit(127);
+
+        const char *args[20];
+        int count = 0;
+
+        args[count++] = benchBinary;
+        args[count++] = "--trace";
+        args[count++] = traceFile;
+        args[count++] = "-G";
+        args[count++] = optionFile;
+        args[count++] = "-T";
+        args[count++] = templateFile;
+        args[count++] = "-N";
+        args[count++] = navCount;
+
+        if (lazy)
+            args[count++] = "-L";
+
+        if (sdlRenderer)
+            args[count++] = "-R";
+
+        if (size != NULL)
+        {
+            args[count++] = "--size";
+            args[count++] = size;
+        }
+
+        args[count] = NULL;
+
+        execv(benchBinary, (char *const *)args);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, '\0', sizeof(usage));
+
+    while (true)
+    {
+        pid_t done = wait4(pid, &status, WNOHANG, &usage);
+
+        if (done == pid)
+            break;
+
+        if (done < 0 && errno != EINTR)
+            return result;
+
+        if (now_ms() - start > BENCH_TIMEOUT * 1000.0)
+        {
+            fprintf(stderr, "bench: %d options timed out.\n", options);
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return result;
+        }
+
+        usleep(1000);
+    }
+
+    result.wallMs    = now_ms() - start;
+    result.peakRssKb = usage.ru_maxrss;
+    result.ok        = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    bench_parse_trace(traceFile, &result);
+
+    if (result.firstPresentMs < 0)
+        result.ok = false;
+
+    return result;
+}
+
+
+static char *sub_vars_strstr(const char *input)
+{   // sub_vars() before templates were compiled, without its logging: strstr for every
+    // marker, a realloc per piece and a copy of every variable name.
+    char *output = NULL;
+
+    const char *last = input;
+    const char *start = strstr(last, "{{");
+    const char *end = NULL;
+
+    while (start != NULL)
+    {
+        if (start > last)
+            output = ez_strcatn(output, last, start - last);
+
+        end = strstr(start, "}}");
+
+        if (end == NULL)
+        {
+            size_t rest = strlen(start);
+            output = ez_strcatn(output, start, rest);
+            last = start + rest;
+            break;
+        }
+
+        start += 2;
+
+        char *var_name = ez_strcatn(NULL, start, end - start);
+        const char *var_value = get_var(var_name);
+
+        if (var_value != NULL)
+            output = ez_strcatn(output, var_value, strlen(var_value));
+        else
+            output = ez_strcatn(output, var_name, strlen(var_name));
+
+        free(var_name);
+
+        end += 2;
+
+        last = end;
+        start = strstr(end, "{{");
+    }
+
+    if (last[0] != 0)
+        output = ez_strcatn(output, last, strlen(last));
+
+    return output;
+}
+
+
+static void bench_templates(FILE *out, int substitutions)
+{   // ns per evaluation: the old strstr path, compiling every time like sub_vars() does, and
+    // evaluating a template compiled once, which is what INI programs do.
+    // The variables come from the environment, see main().
+    char *input = NULL;
+    char name[64];
+
+    for (int i = 0; i < substitutions; i++)
+    {
+        snprintf(name, sizeof(name), "text %d {{bench_var%d}} ", i, i);
+        input = ez_strcatn(input, name, strlen(name));
+    }
+
+    double times[3];
+    double start = now_ms();
+
+    for (int i = 0; i < BENCH_TEMPLATE_EVALS; i++)
+        free(sub_vars_strstr(input));
+
+    times[0] = now_ms() - start;
+    start = now_ms();
+
+    for (int i = 0; i < BENCH_TEMPLATE_EVALS; i++)
+    {
+        Template *tmpl = template_compile(input);
+        free(template_eval(tmpl));
+        template_free(tmpl);
+    }
+
+    times[1] = now_ms() - start;
+
+    Template *tmpl = template_compile(input);
+    start = now_ms();
+
+    for (int i = 0; i < BENCH_TEMPLATE_EVALS; i++)
+        free(template_eval(tmpl));
+
+    times[2] = now_ms() - start;
+
+    template_free(tmpl);
+    free(input);
+
+    for (int i = 0; i < 3; i++)
+        times[i] = times[i] * 1e6 / BENCH_TEMPLATE_EVALS;
+
+    fprintf(stderr, "bench: %3d substitutions: strstr %.0f ns, compile and eval %.0f ns, eval %.0f ns\n",
+        substitutions, times[0], times[1], times[2]);
+
+    fprintf(out, "\n    {\"substitutions\": %d, \"evaluations\": %d, \"strstr_ns\": %.1f, \"compile_eval_ns\": %.1f, \"eval_ns\": %.1f}",
+        substitutions, BENCH_TEMPLATE_EVALS, times[0], times[1], times[2]);
+}
+
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: sdl2imgshow_bench [--binary <sdl2imgshow>] [--font <font.ttf>] [--out <results.json>]\n"
+        "                         [--work <dir>] [--images <n>] [--lines <n>] [--nav <n>]\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (value == NULL)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "--binary") == 0)
+            benchBinary = value;
+        else if (strcmp(argv[i], "--font") == 0)
+            benchFont = value;
+        else if (strcmp(argv[i], "--out") == 0)
+            benchOut = value;
+        else if (strcmp(argv[i], "--work") == 0)
+            benchWork = value;
+        else if (strcmp(argv[i], "--images") == 0)
+            benchImages = atoi(value);
+        else if (strcmp(argv[i], "--lines") == 0)
+            benchLines = atoi(value);
+        else if (strcmp(argv[i], "--nav") == 0)
+            benchNav = atoi(value);
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+
+        i++;
+    }
+
+    char binary[4096];
+
+    if (benchBinary == NULL)
+    {   // Default to the sdl2imgshow built next to us.
+        const char *slash = strrchr(argv[0], '/');
+        int length = (slash == NULL) ? 0 : (int)(slash - argv[0]) + 1;
+
+        snprintf(binary, sizeof(binary), "%.*ssdl2imgshow", length, argv[0]);
+        benchBinary = binary;
+    }
+
+    if (benchFont == NULL)
+    {
+        for (size_t i = 0; i < sizeof(defaultFonts) / sizeof(defaultFonts[0]); i++)
+        {
+            if (access(defaultFonts[i], R_OK) == 0)
+            {
+                benchFont = defaultFonts[i];
+                break;
+            }
+        }
+
+        if (benchFont == NULL)
+            fprintf(stderr, "bench: no font found, text lines are skipped. Use --font.\n");
+    }
+
+    char work[4096];
+
+    if (benchWork == NULL)
+    {
+        snprintf(work, sizeof(work), "%s/sdl2imgshow_bench.XXXXXX", (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp");
+
+        if (mkdtemp(work) == NULL)
+        {
+            fprintf(stderr, "bench: mkdtemp: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        benchWork = work;
+    }
+    else if (mkdir(benchWork, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "bench: %s: %s\n", benchWork, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Typical box art / background images, and small tiles for the layer count runs.
+    if (IMG_Init(IMG_INIT_PNG) != IMG_INIT_PNG ||
+        !bench_images(benchWork, "image", 1280, 720) || !bench_images(benchWork, "tile", 64, 64))
+    {
+        fprintf(stderr, "bench: couldn't generate images.\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = fopen(benchOut, "w");
+
+    if (out == NULL)
+    {
+        fprintf(stderr, "bench: couldn't open %s: %s\n", benchOut, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n  \"binary\": \"%s\",\n  \"images\": %d,\n  \"lines\": %d,\n  \"navigations\": %d,\n  \"results\": [",
+        benchBinary, benchImages, (benchFont != NULL) ? benchLines : 0, benchNav);
+
+    static const int optionCounts[] = {1, 100, 1000};
+    bool first = true;
+    bool failed = false;
+
+    for (size_t i = 0; i < sizeof(optionCounts) / sizeof(optionCounts[0]); i++)
+    {
+        int options = optionCounts[i];
+
+        if (!bench_configs(benchWork, options))
+        {
+            fprintf(stderr, "bench: couldn't write configs in %s\n", benchWork);
+            failed = true;
+            break;
+        }
+
+        for (int lazy = 0; lazy < 2; lazy++)
+        {
+            Bench_Result result = bench_run(benchWork, options, lazy, NULL, false);
+
+            fprintf(stderr, "bench: %4d options%s: %s, first present %.1f ms, wall %.1f ms, peak rss %ld KiB, navigate mean %.2f ms\n",
+                options, lazy ? " (lazy)" : "", result.ok ? "ok" : "FAILED",
+                result.firstPresentMs, result.wallMs, result.peakRssKb, result.navMeanMs);
+
+            fprintf(out, "%s\n    {\"options\": %d, \"lazy\": %s, \"ok\": %s, \"first_present_ms\": %.3f, \"wall_ms\": %.3f, "
+                "\"peak_rss_kb\": %ld, \"navigate\": {\"count\": %d, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"max_ms\": %.3f}}",
+                first ? "" : ",", options, lazy ? "true" : "false", result.ok ? "true" : "false",
+                result.firstPresentMs, result.wallMs, result.peakRssKb,
+                result.navCount, result.navMeanMs, result.navP50Ms, result.navMaxMs);
+
+            first = false;
+            failed |= !result.ok;
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"software\": [");
+
+    // Both software paths at common handheld and TV sizes. Every option is loaded up front,
+    // so navigating is just drawing, and its latency is the cost of a frame.
+    static const char *sizes[] = {"640x480", "1280x720", "1920x1080"};
+    first = true;
+
+    if (!failed && bench_configs(benchWork, 100))
+    {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            for (int sdlRenderer = 0; sdlRenderer < 2; sdlRenderer++)
+            {
+                Bench_Result result = bench_run(benchWork, 100, false, sizes[i], sdlRenderer);
+
+                fprintf(stderr, "bench: %9s %-10s: %s, first present %.1f ms, navigate mean %.2f ms, p50 %.2f ms\n",
+                    sizes[i], sdlRenderer ? "renderer" : "compositor", result.ok ? "ok" : "FAILED",
+                    result.firstPresentMs, result.navMeanMs, result.navP50Ms);
+
+                fprintf(out, "%s\n    {\"size\": \"%s\", \"path\": \"%s\", \"ok\": %s, \"first_present_ms\": %.3f, "
+                    "\"peak_rss_kb\": %ld, \"navigate\": {\"count\": %d, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"max_ms\": %.3f}}",
+                    first ? "" : ",", sizes[i], sdlRenderer ? "renderer" : "compositor", result.ok ? "true" : "false",
+                    result.firstPresentMs, result.peakRssKb,
+                    result.navCount, result.navMeanMs, result.navP50Ms, result.navMaxMs);
+
+                first = false;
+                failed |= !result.ok;
+            }
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"layers\": [");
+
+    // Scene building and the per-frame walk over the display list, with far more layers
+    // than any real template. Image decoding is shared, there are only a few distinct tiles.
+    static const int layerCounts[] = {1000, 5000};
+    first = true;
+
+    for (size_t i = 0; !failed && i < sizeof(layerCounts) / sizeof(layerCounts[0]); i++)
+    {
+        if (!bench_layer_configs(benchWork, layerCounts[i]))
+        {
+            fprintf(stderr, "bench: couldn't write configs in %s\n", benchWork);
+            failed = true;
+            break;
+        }
+
+        Bench_Result result = bench_run(benchWork, BENCH_LAYER_OPTIONS, false, NULL, false);
+
+        fprintf(stderr, "bench: %5d layers: %s, option_load mean %.2f ms, display_list_draw mean %.2f ms, navigate mean %.2f ms\n",
+            layerCounts[i], result.ok ? "ok" : "FAILED", result.loadMeanMs, result.drawMeanMs, result.navMeanMs);
+
+        fprintf(out, "%s\n    {\"layers\": %d, \"options\": %d, \"ok\": %s, \"first_present_ms\": %.3f, \"peak_rss_kb\": %ld, "
+            "\"option_load\": {\"count\": %d, \"mean_ms\": %.3f}, \"display_list_draw\": {\"count\": %d, \"mean_ms\": %.3f}, "
+            "\"navigate\": {\"count\": %d, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"max_ms\": %.3f}}",
+            first ? "" : ",", layerCounts[i], BENCH_LAYER_OPTIONS, result.ok ? "true" : "false",
+            result.firstPresentMs, result.peakRssKb,
+            result.loadCount, result.loadMeanMs, result.drawCount, result.drawMeanMs,
+            result.navCount, result.navMeanMs, result.navP50Ms, result.navMaxMs);
+
+        first = false;
+        failed |= !result.ok;
+    }
+
+    fprintf(out, "\n  ],\n  \"templates\": [");
+
+    static const int substitutionCounts[] = {4, 32, 256};
+
+    // Set before init_vars() reads the environment, set_var() would log every one of them.
+    // No more children are started, so they don't leak into any run.
+    for (int i = 0; i < substitutionCounts[2]; i++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "bench_var%d", i);
+        setenv(name, "Some value of a typical length", 1);
+    }
+
+    init_vars();
+
+    for (size_t i = 0; i < sizeof(substitutionCounts) / sizeof(substitutionCounts[0]); i++)
+    {
+        if (i > 0)
+            fputc(',', out);
+
+        bench_templates(out, substitutionCounts[i]);
+    }
+
+    quit_vars();
+
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+
+    IMG_Quit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+// CPU compositor, used instead of SDL's software renderer when there is no GPU. That
+// renderer blends every layer through its generic per-pixel path, colour mod included.
+// Here images and glyph pages stay ARGB8888 surfaces and are blended straight into the
+// window surface, which keeps the finished frame between presents, so only the damaged
+// rect is ever composed again.
+//
+// Each kernel does one row, red and blue share a 32 bit lane so one multiply covers both.
+// There are no branches in the loops, so the compiler vectorizes them too.
+
+enum
+{
+    COMPOSE_COPY,           // opaque, no colour mod: a straight row copy.
+    COMPOSE_COPY_MOD,       // opaque, colour mod.
+    COMPOSE_ALPHA,          // alpha, no colour mod.
+    COMPOSE_ALPHA_MOD,      // alpha and colour mod.
+    COMPOSE_MASK,           // white with alpha, the colour mod is the colour. Text.
+    COMPOSE_KERNELS,
+};
+
+bool cpuCompositor = false;
+
+static SDL_Surface *composeTarget = NULL;
+static Uint32 *composeRow = NULL;       // a row of scaled source pixels.
+static int    *composeMap = NULL;       // source column for each destination column.
+
+static Sint64 composePixels[COMPOSE_KERNELS];
+static const char *composeNames[COMPOSE_KERNELS] = {"copied", "copied with colour", "blended", "blended with colour", "text"};
+
+
+static inline Uint32 mul255(Uint32 a, Uint32 b)
+{   // a * b / 255, rounded.
+    Uint32 t = a * b + 128;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+
+static inline Uint32 blend_pixel(Uint32 src, Uint32 dst, Uint32 alpha)
+{   // (src * alpha + dst * (255 - alpha)) / 255 per channel, rounded. The result is opaque.
+    Uint32 inverse = 255 - alpha;
+    Uint32 rb = (src & 0xFF00FF) * alpha + (dst & 0xFF00FF) * inverse + 0x800080;
+    Uint32 g  = (src & 0x00FF00) * alpha + (dst & 0x00FF00) * inverse + 0x008000;
+
+    rb = ((rb + ((rb >> 8) & 0xFF00FF)) >> 8) & 0xFF00FF;
+    g  = ((g  + ((g  >> 8) & 0x00FF00)) >> 8) & 0x00FF00;
+
+    return 0xFF000000 | rb | g;
+}
+
+
+static inline Uint32 modulate_pixel(Uint32 src, SDL_Color mod)
+{
+    return (src & 0xFF000000) |
+        (mul255((src >> 16) & 0xFF, mod.r) << 16) |
+        (mul255((src >>  8) & 0xFF, mod.g) <<  8) |
+         mul255( src        & 0xFF, mod.b);
+}
+
+
+static void compose_row(int kernel, Uint32 *dst, const Uint32 *src, int count, SDL_Color mod)
+{
+    Uint32 color = 0xFF000000 | (mod.r << 16) | (mod.g << 8) | mod.b;
+
+    switch (kernel)
+    {
+    case COMPOSE_COPY:
+        memcpy(dst, src, count * sizeof(Uint32));
+        break;
+
+    case COMPOSE_COPY_MOD:
+        for (int i = 0; i < count; i++)
+            dst[i] = 0xFF000000 | modulate_pixel(src[i], mod);
+        break;
+
+    case COMPOSE_ALPHA:
+        for (int i = 0; i < count; i++)
+            dst[i] = blend_pixel(src[i], dst[i], src[i] >> 24);
+        break;
+
+    case COMPOSE_ALPHA_MOD:
+        for (int i = 0; i < count; i++)
+            dst[i] = blend_pixel(modulate_pixel(src[i], mod), dst[i], src[i] >> 24);
+        break;
+
+    case COMPOSE_MASK:
+        for (int i = 0; i < count; i++)
+            dst[i] = blend_pixel(color, dst[i], src[i] >> 24);
+        break;
+    }
+}
+
+
+static int compose_kernel(const Texture_Entry *entry, SDL_Color mod)
+{
+    bool white = (mod.r == 255 && mod.g == 255 && mod.b == 255);
+
+    if (entry->mask)
+        return COMPOSE_MASK;
+
+    if (entry->opaque)
+        return white ? COMPOSE_COPY : COMPOSE_COPY_MOD;
+
+    return white ? COMPOSE_ALPHA : COMPOSE_ALPHA_MOD;
+}
+
+
+static void compose_layer(const Texture_Entry *entry, const SDL_Rect *srcRect, const SDL_Rect *dstRect,
+    SDL_Color mod, const SDL_Rect *clip)
+{   // Nearest neighbour when the sizes differ, like SDL's software renderer.
+    SDL_Surface *source = entry->surface;
+    SDL_Rect area;
+
+    if (source == NULL || dstRect->w <= 0 || dstRect->h <= 0 || !SDL_IntersectRect(dstRect, clip, &area))
+        return;
+
+    SDL_Rect src = {0, 0, source->w, source->h};
+
+    if (srcRect != NULL)
+        src = *srcRect;
+
+    bool scaled = (src.w != dstRect->w || src.h != dstRect->h);
+    int kernel = compose_kernel(entry, mod);
+
+    if (scaled)
+    {
+        for (int x = 0; x < area.w; x++)
+            composeMap[x] = src.x + (int)((Sint64)(area.x + x - dstRect->x) * src.w / dstRect->w);
+    }
+
+    for (int y = area.y; y < area.y + area.h; y++)
+    {
+        int sourceY = src.y + (int)((Sint64)(y - dstRect->y) * src.h / dstRect->h);
+        const Uint32 *row = (const Uint32*)((const Uint8*)source->pixels + sourceY * source->pitch);
+        Uint32 *out = (Uint32*)((Uint8*)composeTarget->pixels + y * composeTarget->pitch) + area.x;
+
+        if (scaled)
+        {
+            for (int x = 0; x < area.w; x++)
+                composeRow[x] = row[composeMap[x]];
+
+            row = composeRow;
+        }
+        else
+        {
+            row += src.x + (area.x - dstRect->x);
+        }
+
+        compose_row(kernel, out, row, area.w, mod);
+    }
+
+    composePixels[kernel] += (Sint64)area.w * area.h;
+}
+
+
+bool compose_init(SDL_Surface *target)
+{   // Only 32 bit xRGB window surfaces, anything else is left to SDL's renderer.
+    if (target == NULL ||
+        (target->format->format != SDL_PIXELFORMAT_ARGB8888 && target->format->format != SDL_PIXELFORMAT_RGB888))
+        return false;
+
+    composeTarget = target;
+    composeRow = (Uint32*)ez_malloc(target->w * sizeof(Uint32));
+    composeMap = (int*)ez_malloc(target->w * sizeof(int));
+
+    cpuCompositor = true;
+    return true;
+}
+
+
+bool compose_opaque(const SDL_Surface *surface)
+{   // Called on loader threads, so an opaque image is found out before it ever gets drawn.
+    Uint32 alpha = 0xFF000000;
+
+    for (int y = 0; y < surface->h; y++)
+    {
+        const Uint32 *row = (const Uint32*)((const Uint8*)surface->pixels + y * surface->pitch);
+
+        for (int x = 0; x < surface->w; x++)
+            alpha &= row[x];
+
+        if (alpha != 0xFF000000)
+            return false;
+    }
+
+    return true;
+}
+
+
+void compose_list(Display_List *list, const SDL_Rect *clip)
+{
+    if (SDL_MUSTLOCK(composeTarget) && SDL_LockSurface(composeTarget) != 0)
+        return;
+
+    // Nothing else clears what a removed layer left behind.
+    for (int y = clip->y; y < clip->y + clip->h; y++)
+    {
+        Uint32 *out = (Uint32*)((Uint8*)composeTarget->pixels + y * composeTarget->pitch) + clip->x;
+
+        for (int x = 0; x < clip->w; x++)
+            out[x] = 0xFF000000;
+    }
+
+    for (int i = 0; i < list->count; i++)
+    {
+        Image_Object *image = &list->items[i];
+
+        if (image->text != NULL)
+        {
+            Text_Run *run = image->text;
+
+            for (int j = 0; j < run->count; j++)
+            {
+                Glyph_Quad *quad = &run->quads[j];
+                SDL_Rect dst = {
+                    image->imageRect.x + quad->dst.x, image->imageRect.y + quad->dst.y,
+                    quad->dst.w, quad->dst.h};
+
+                compose_layer(quad->page, &quad->src, &dst, image->drawColor, clip);
+            }
+        }
+        else if (image_layout(image))
+        {
+            compose_layer(image->texture, NULL, &image->imageRect, image->drawColor, clip);
+        }
+    }
+
+    if (SDL_MUSTLOCK(composeTarget))
+        SDL_UnlockSurface(composeTarget);
+}
+
+
+void compose_stats()
+{
+    if (!cpuCompositor)
+        return;
+
+    fprintf(stderr, "compositor:");
+
+    for (int i = 0; i < COMPOSE_KERNELS; i++)
+        fprintf(stderr, "%s %.1f Mpx %s", (i == 0) ? "" : ",", composePixels[i] / 1e6, composeNames[i]);
+
+    fprintf(stderr, "\n");
+}
+
+
+void compose_quit()
+{
+    free(composeRow);
+    free(composeMap);
+
+    composeRow = NULL;
+    composeMap = NULL;
+    composeTarget = NULL;
+}
@@ -0,0 +1,400 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Daemon mode: sdl2imgshow --listen <path> keeps running and takes INI lines, plus
+// "clear", "present" and "quit", from a Unix socket or a named pipe at <path>.
+// sdl2imgshow --send <path> [line ...] sends lines to it, from stdin if none are given.
+//
+// Lines build up in root_list, what is on screen is a copy taken at the last "present",
+// so nothing shows half-built.
+
+#define DAEMON_LINE_MAX 65536
+
+Uint32 daemonEvent = 0;
+
+static const char *daemonPath   = NULL;
+static SDL_Thread *daemonThread = NULL;
+static int         daemonFd     = -1;
+static bool        daemonFifo   = false;
+static int         daemonStop[2] = {-1, -1};    // written to by daemon_quit().
+static Display_List *daemonScene = NULL;   // what the last present committed.
+
+
+static bool daemon_is_fifo(const char *path)
+{
+    struct stat info;
+
+    return stat(path, &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
+
+static int daemon_send(const char *path, int count, char *lines[])
+{   // Client side, nothing else is initialised.
+    int fd;
+
+    if (daemon_is_fifo(path))
+    {
+        fd = open(path, O_WRONLY | O_CLOEXEC);
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, '\0', sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "send: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fdopen(fd, "w");
+
+    if (count > 0)
+    {
+        for (int i = 0; i < count; i++)
+            fprintf(file, "%s\n", lines[i]);
+    }
+    else
+    {
+        char line[4096];
+
+        while (fgets(line, sizeof(line), stdin))
+            fputs(line, file);
+    }
+
+    return (fclose(file) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+void daemon_args(int *argc, char *argv[])
+{   // Handles --send <path> straight away, and takes --listen <path> out of argv.
+    int out = 1;
+
+    for (int i = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--send") == 0 && i + 1 < *argc)
+            exit(daemon_send(argv[i + 1], *argc - i - 2, argv + i + 2));
+
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < *argc)
+        {
+            daemonPath = argv[++i];
+            continue;
+        }
+
+        argv[out++] = argv[i];
+    }
+
+    argv[out] = NULL;
+    *argc = out;
+}
+
+
+static void daemon_push(const char *line, size_t length)
+{   // Commands are run on the main thread, ini_parse isn't thread safe.
+    SDL_Event event;
+    memset(&event, '\0', sizeof(event));
+
+    event.type = daemonEvent;
+    event.user.data1 = ez_strcatn(NULL, line, length);
+
+    SDL_PushEvent(&event);
+}
+
+
+static bool daemon_wait(int fd)
+{   // Blocks until fd can be read, false once daemon_quit() wants the thread back.
+    // A client that stays connected would otherwise keep it in read() for ever.
+    struct pollfd fds[2] = {{fd, POLLIN, 0}, {daemonStop[0], POLLIN, 0}};
+
+    while (poll(fds, 2, -1) < 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+
+    return fds[1].revents == 0;
+}
+
+
+static void daemon_read(int fd)
+{   // Splits whatever arrives into lines, a line can span several reads.
+    char *buffer = (char*)ez_malloc(DAEMON_LINE_MAX);
+    size_t used = 0;
+    bool stopped = false;
+
+    while (true)
+    {
+        if (!daemon_wait(fd))
+        {
+            stopped = true;
+            break;
+        }
+
+        ssize_t got = read(fd, buffer + used, DAEMON_LINE_MAX - used);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            break;
+
+        used += got;
+
+        char *start = buffer;
+        char *end;
+
+        while ((end = (char*)memchr(start, '\n', used - (start - buffer))) != NULL)
+        {
+            daemon_push(start, end - start);
+            start = end + 1;
+        }
+
+        used -= start - buffer;
+        memmove(buffer, start, used);
+
+        if (used == DAEMON_LINE_MAX)
+        {
+            fprintf(stderr, "daemon: line too long, dropped.\n");
+            used = 0;
+        }
+    }
+
+    if (used > 0 && !stopped)
+        daemon_push(buffer, used);
+
+    free(buffer);
+}
+
+
+static int daemon_thread(void *data)
+{
+    UNUSED(data);
+
+    if (daemonFifo)
+    {   // Opened read/write, so it never sees EOF when a writer goes away.
+        daemon_read(daemonFd);
+        return 0;
+    }
+
+    while (daemon_wait(daemonFd))
+    {
+        int client = accept(daemonFd, NULL, NULL);
+
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            break;
+        }
+
+        daemon_read(client);
+        close(client);
+    }
+
+    return 0;
+}
+
+
+bool daemon_start()
+{
+    if (daemonPath == NULL)
+        return false;
+
+    daemonEvent = SDL_RegisterEvents(1);
+
+    if (daemon_is_fifo(daemonPath))
+    {
+        daemonFifo = true;
+        daemonFd = open(daemonPath, O_RDWR | O_CLOEXEC);
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, '\0', sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (strlen(daemonPath) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "daemon: %s: path too long.\n", daemonPath);
+            return false;
+        }
+
+        strcpy(addr.sun_path, daemonPath);
+
+        // A socket left over from a previous run would make bind fail. Anything else at
+        // the path is somebody's file, never delete that.
+        struct stat info;
+
+        if (lstat(daemonPath, &info) == 0)
+        {
+            if (!S_ISSOCK(info.st_mode))
+            {
+                fprintf(stderr, "daemon: %s exists and isn't a socket or named pipe.\n", daemonPath);
+                return false;
+            }
+
+            unlink(daemonPath);
+        }
+
+        daemonFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        // Every line is run as INI, so only our own user may connect.
+        mode_t mask = umask(0077);
+
+        if (daemonFd >= 0 &&
+            (bind(daemonFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(daemonFd, 4) != 0))
+        {
+            close(daemonFd);
+            daemonFd = -1;
+        }
+
+        umask(mask);
+    }
+
+    if (daemonFd < 0)
+    {
+        fprintf(stderr, "daemon: %s: %s\n", daemonPath, strerror(errno));
+        return false;
+    }
+
+    if (pipe(daemonStop) != 0)
+    {
+        fprintf(stderr, "daemon: pipe: %s\n", strerror(errno));
+        close(daemonFd);
+        daemonFd = -1;
+        return false;
+    }
+
+    daemonThread = SDL_CreateThread(&daemon_thread, "daemon", NULL);
+
+    if (daemonThread == NULL)
+    {
+        fprintf(stderr, "SDL_CreateThread Error: %s\n", SDL_GetError());
+        close(daemonFd);
+        daemonFd = -1;
+        return false;
+    }
+
+    // Whatever the startup config drew stays up until the first present. In option mode
+    // the selected option is drawn instead, so there is nothing to hold.
+    if (root_option == NULL)
+        daemonScene = display_list_clone(root_list);
+
+    fprintf(stderr, "daemon: listening on %s\n", daemonPath);
+    return true;
+}
+
+
+Display_List *daemon_scene()
+{   // The list to draw.
+    return (daemonScene != NULL) ? daemonScene : root_list;
+}
+
+
+static void daemon_present()
+{   // Commits everything sent so far. Its images are waited for, so it appears in one frame.
+    if (daemonScene == NULL)
+        return;
+
+    image_loader_flush();
+
+    // Cloned before the old one goes, textures both use are kept rather than freed and loaded again.
+    Display_List *scene = display_list_clone(root_list);
+
+    display_list_free(daemonScene);
+    daemonScene = scene;
+}
+
+
+int daemon_command(SDL_Event *event)
+{   // Runs one line from the daemon, returns DAEMON_PRESENT or DAEMON_QUIT when the main loop has work.
+    char *line = (char*)event->user.data1;
+    int result = DAEMON_NONE;
+
+    if (line == NULL)
+        return result;
+
+    char *command = line;
+
+    while (isspace((unsigned char)*command))
+        command++;
+
+    size_t length = strlen(command);
+
+    while (length > 0 && isspace((unsigned char)command[length - 1]))
+        command[--length] = '\0';
+
+    if (strcasecmp(command, "clear") == 0)
+    {
+        display_list_clear(root_list);
+    }
+    else if (strcasecmp(command, "present") == 0)
+    {
+        daemon_present();
+        result = DAEMON_PRESENT;
+    }
+    else if (strcasecmp(command, "quit") == 0)
+    {
+        result = DAEMON_QUIT;
+    }
+    else
+    {   // Anything else is an INI line, same as a config file.
+        ini_read_buffer(command, length, &ini_parse, NULL);
+    }
+
+    free(line);
+    return result;
+}
+
+
+void daemon_quit()
+{
+    if (daemonThread != NULL)
+    {   // Wakes the thread whether it waits in accept() or on a client that is still connected.
+        if (write(daemonStop[1], "", 1) < 0)
+            fprintf(stderr, "daemon: %s\n", strerror(errno));
+
+        SDL_WaitThread(daemonThread, NULL);
+        daemonThread = NULL;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (daemonStop[i] >= 0)
+            close(daemonStop[i]);
+
+        daemonStop[i] = -1;
+    }
+
+    if (daemonFd >= 0)
+    {
+        close(daemonFd);
+        daemonFd = -1;
+
+        if (!daemonFifo)
+            unlink(daemonPath);
+    }
+
+    display_list_free(daemonScene);
+    daemonScene = NULL;
+}
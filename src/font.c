@@ -0,0 +1,471 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#define GLYPH_ATLAS_SIZE 512
+#define MAX_RENDER_LINES 10
+
+typedef struct _Glyph_Info
+{
+    Texture_Entry *page;    // NULL if there is nothing to draw, like a space.
+    SDL_Rect src;
+    int      xoffset;
+    int      advance;
+    bool     ready;
+} Glyph_Info;
+
+typedef struct _Font_Entry
+{
+    struct _Font_Entry *next;
+    char     *path;
+    int       size;
+    TTF_Font *font;
+    File_Map *map;          // shared by every size of the same file, TTF reads it for as long as the font is open.
+
+    // Glyph atlas, text is rendered as LATIN1 so 256 glyphs covers everything.
+    Glyph_Info     *glyphs;
+    Texture_Entry **pages;
+    int             pageCount;
+    int             penX;
+    int             penY;
+    int             rowHeight;
+} Font_Entry;
+
+int fontCacheSize = 8;
+
+// Most recently used first.
+static Font_Entry *fontCache = NULL;
+static int fontCacheCount = 0;
+
+static int fontCacheHits      = 0;
+static int fontCacheMisses    = 0;
+static int fontCacheEvictions = 0;
+static int glyphsRasterized   = 0;
+
+
+static void font_entry_free(Font_Entry *entry)
+{   // Text that is still on screen keeps its own reference to the atlas pages.
+    for (int i = 0; i < entry->pageCount; i++)
+        texture_release(entry->pages[i]);
+
+    TTF_CloseFont(entry->font);
+    file_map_release(entry->map);
+
+    free(entry->pages);
+    free(entry->glyphs);
+    free(entry->path);
+    free(entry);
+}
+
+
+void font_cache_trim()
+{   // Drop the least recently used fonts, but never the one being drawn with.
+    while (fontCacheCount > fontCacheSize)
+    {
+        Font_Entry **current = &fontCache;
+        Font_Entry **victim = NULL;
+
+        while (*current != NULL)
+        {
+            if ((*current)->font != globalFont)
+                victim = current;
+
+            current = &(*current)->next;
+        }
+
+        if (victim == NULL)
+            break;
+
+        Font_Entry *entry = *victim;
+        *victim = entry->next;
+
+        font_entry_free(entry);
+
+        fontCacheCount--;
+        fontCacheEvictions++;
+    }
+}
+
+
+TTF_Font *font_cache_open(const char *path, int size)
+{
+    Font_Entry **current = &fontCache;
+    File_Map *map = NULL;
+
+    while (*current != NULL)
+    {
+        Font_Entry *entry = *current;
+
+        if (map == NULL && strcmp(entry->path, path) == 0)
+            map = entry->map;
+
+        if (entry->size == size && strcmp(entry->path, path) == 0)
+        {   // Move it to the front.
+            *current = entry->next;
+            entry->next = fontCache;
+            fontCache = entry;
+
+            fontCacheHits++;
+            return entry->font;
+        }
+
+        current = &entry->next;
+    }
+
+    fontCacheMisses++;
+
+    // A new size of a font that is already open reuses its mapping, so the file is opened once.
+    // Otherwise the failed open is the existence check, no separate probe needed.
+    map = (map != NULL) ? file_map_ref(map) : file_map(path, false);
+
+    if (map == NULL)
+    {
+        fprintf(stderr, "load_font: %s: file doesn't exist.\n", path);
+        return NULL;
+    }
+
+    TRACE_BEGIN("TTF_OpenFont", path);
+    TTF_Font *font = TTF_OpenFontRW(SDL_RWFromConstMem(map->data, (int)map->size), 1, size);
+    TRACE_END("TTF_OpenFont");
+
+    if (font == NULL)
+    {
+        fprintf(stderr, "TTF: Couldn't load %s: %s\n", path, TTF_GetError());
+        file_map_release(map);
+        return NULL;
+    }
+
+    Font_Entry *entry = (Font_Entry*)ez_malloc(sizeof(Font_Entry));
+
+    entry->path   = strdup(path);
+    entry->size   = size;
+    entry->font   = font;
+    entry->map    = map;
+    entry->glyphs = (Glyph_Info*)ez_malloc(256 * sizeof(Glyph_Info));
+
+    entry->next = fontCache;
+    fontCache = entry;
+    fontCacheCount++;
+
+    return font;
+}
+
+
+void font_cache_quit()
+{
+    while (fontCache != NULL)
+    {
+        Font_Entry *next = fontCache->next;
+
+        font_entry_free(fontCache);
+
+        fontCache = next;
+    }
+
+    fontCacheCount = 0;
+    globalFont = NULL;
+}
+
+
+void font_cache_stats()
+{
+    fprintf(stderr, "font_cache: %d open, %d hits, %d misses, %d evictions\n",
+        fontCacheCount, fontCacheHits, fontCacheMisses, fontCacheEvictions);
+    fprintf(stderr, "glyph_atlas: %d glyphs rasterized\n", glyphsRasterized);
+}
+
+
+static Texture_Entry *font_atlas_page_surface()
+{   // The CPU compositor reads glyphs straight from memory, SDL zeroes new surfaces.
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 32, SDL_PIXELFORMAT_ARGB8888);
+
+    if (surface == NULL)
+    {
+        fprintf(stderr, "SDL_CreateRGBSurfaceWithFormat Error: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    Texture_Entry *page = texture_create_surface(surface);
+    page->mask = true;
+
+    return page;
+}
+
+
+static Texture_Entry *font_atlas_page_texture()
+{
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STATIC, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE);
+
+    if (texture == NULL)
+    {
+        fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    // Start fully transparent, so filtering at glyph edges doesn't pick up garbage.
+    void *blank = ez_malloc(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE * 4);
+    SDL_UpdateTexture(texture, NULL, blank, GLYPH_ATLAS_SIZE * 4);
+    free(blank);
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    return texture_create(texture);
+}
+
+
+static Texture_Entry *font_atlas_page(Font_Entry *entry)
+{
+    Texture_Entry *page = cpuCompositor ? font_atlas_page_surface() : font_atlas_page_texture();
+
+    if (page == NULL)
+        return NULL;
+
+    entry->pages = (Texture_Entry**)realloc(entry->pages, (entry->pageCount + 1) * sizeof(Texture_Entry*));
+    if (entry->pages == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory. :(\n");
+        exit(255);
+    }
+
+    entry->pages[entry->pageCount++] = page;
+
+    entry->penX = 0;
+    entry->penY = 0;
+    entry->rowHeight = 0;
+
+    return page;
+}
+
+
+static Glyph_Info *font_glyph(Font_Entry *entry, Uint8 ch)
+{   // Rasterize a glyph into the atlas the first time it is used.
+    Glyph_Info *glyph = &entry->glyphs[ch];
+
+    if (glyph->ready)
+        return glyph;
+
+    glyph->ready = true;
+
+    int minx, maxx, miny, maxy, advance;
+    if (TTF_GlyphMetrics(entry->font, ch, &minx, &maxx, &miny, &maxy, &advance) != 0)
+        return glyph;
+
+    glyph->advance = advance;
+
+    // Rendering it as a one character string keeps the same placement as whole string rendering.
+    char text[2] = {(char)ch, '\0'};
+    SDL_Surface *surface = TTF_RenderText_Blended(entry->font, text, (SDL_Color){255, 255, 255, 255});
+
+    if (surface == NULL)
+        return glyph;
+
+    glyph->xoffset = (minx < 0) ? minx : 0;
+
+    if (surface->w > GLYPH_ATLAS_SIZE || surface->h > GLYPH_ATLAS_SIZE)
+    {
+        fprintf(stderr, "glyph_atlas: glyph %d is too big for the atlas.\n", ch);
+        SDL_FreeSurface(surface);
+        return glyph;
+    }
+
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888)
+    {
+        SDL_Surface *convertedSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+
+        if (convertedSurface == NULL)
+            return glyph;
+
+        surface = convertedSurface;
+    }
+
+    // Simple shelf packing, a one pixel gap stops glyphs bleeding into each other.
+    if (entry->penX + surface->w > GLYPH_ATLAS_SIZE)
+    {
+        entry->penX = 0;
+        entry->penY += entry->rowHeight + 1;
+        entry->rowHeight = 0;
+    }
+
+    Texture_Entry *page = NULL;
+
+    if (entry->pageCount > 0 && entry->penY + surface->h <= GLYPH_ATLAS_SIZE)
+        page = entry->pages[entry->pageCount - 1];
+    else
+        page = font_atlas_page(entry);
+
+    if (page == NULL)
+    {
+        SDL_FreeSurface(surface);
+        return glyph;
+    }
+
+    glyph->page  = page;
+    glyph->src.x = entry->penX;
+    glyph->src.y = entry->penY;
+    glyph->src.w = surface->w;
+    glyph->src.h = surface->h;
+
+    if (page->surface != NULL)
+    {
+        for (int y = 0; y < glyph->src.h; y++)
+        {
+            memcpy((Uint8*)page->surface->pixels + (glyph->src.y + y) * page->surface->pitch + glyph->src.x * 4,
+                (const Uint8*)surface->pixels + y * surface->pitch, glyph->src.w * 4);
+        }
+    }
+    else
+    {
+        SDL_UpdateTexture(page->texture, &glyph->src, surface->pixels, surface->pitch);
+    }
+
+    SDL_FreeSurface(surface);
+
+    entry->penX += glyph->src.w + 1;
+
+    if (glyph->src.h > entry->rowHeight)
+        entry->rowHeight = glyph->src.h;
+
+    glyphsRasterized++;
+
+    return glyph;
+}
+
+
+static int font_line_width(Font_Entry *entry, const char *line)
+{
+    int width = 0;
+    Uint8 prev = 0;
+
+    for (const Uint8 *ch = (const Uint8*)line; *ch; ch++)
+    {
+        if (prev != 0)
+            width += TTF_GetFontKerningSizeGlyphs(entry->font, prev, *ch);
+
+        width += font_glyph(entry, *ch)->advance;
+        prev = *ch;
+    }
+
+    return width;
+}
+
+
+Text_Run *font_render_text(TTF_Font *font, const char *text, int alignment)
+{   // Lay `text` out as quads from the glyph atlas, lines are split by `||`.
+    Font_Entry *entry = fontCache;
+
+    while (entry != NULL && entry->font != font)
+        entry = entry->next;
+
+    if (entry == NULL)
+        return NULL;
+
+    char *copy = strdup(text);
+    char *rest = copy;
+    char *token;
+    const char *lines[MAX_RENDER_LINES];
+    int widths[MAX_RENDER_LINES];
+    int numLines = 0;
+    int numGlyphs = 0;
+    int maxWidth = 0;
+
+    while (numLines < MAX_RENDER_LINES && (token = strtok_r(rest, "||", &rest)))
+    {
+        lines[numLines] = token;
+        widths[numLines] = font_line_width(entry, token);
+
+        if (widths[numLines] > maxWidth)
+            maxWidth = widths[numLines];
+
+        numGlyphs += strlen(token);
+        numLines++;
+    }
+
+    if (numLines == 0)
+    {
+        free(copy);
+        return NULL;
+    }
+
+    Text_Run *run = (Text_Run*)ez_malloc(sizeof(Text_Run));
+
+    run->refs   = 1;
+    run->width  = maxWidth;
+    run->height = numLines * TTF_FontLineSkip(font);
+    run->quads  = (Glyph_Quad*)ez_malloc(numGlyphs * sizeof(Glyph_Quad));
+
+    int yOffset = 0;
+
+    for (int i = 0; i < numLines; ++i)
+    {
+        int xOffset = 0;
+
+        if (alignment == ALIGN_CENTER)
+        {   // Center alignment
+            xOffset = (maxWidth - widths[i]) / 2;
+        }
+        else if (alignment == ALIGN_RIGHT)
+        {   // Right alignment
+            xOffset = maxWidth - widths[i];
+        }
+
+        Uint8 prev = 0;
+
+        for (const Uint8 *ch = (const Uint8*)lines[i]; *ch; ch++)
+        {
+            Glyph_Info *glyph = font_glyph(entry, *ch);
+
+            if (prev != 0)
+                xOffset += TTF_GetFontKerningSizeGlyphs(font, prev, *ch);
+
+            if (glyph->page != NULL)
+            {
+                Glyph_Quad *quad = &run->quads[run->count++];
+
+                quad->page  = texture_ref(glyph->page);
+                quad->src   = glyph->src;
+                quad->dst.x = xOffset + glyph->xoffset;
+                quad->dst.y = yOffset;
+                quad->dst.w = glyph->src.w;
+                quad->dst.h = glyph->src.h;
+            }
+
+            xOffset += glyph->advance;
+            prev = *ch;
+        }
+
+        yOffset += TTF_FontLineSkip(font);
+    }
+
+    free(copy);
+
+    return run;
+}
+
+
+Text_Run *text_run_ref(Text_Run *run)
+{
+    if (run != NULL)
+        run->refs++;
+
+    return run;
+}
+
+
+void text_run_release(Text_Run *run)
+{
+    if (run == NULL)
+        return;
+
+    run->refs--;
+
+    if (run->refs > 0)
+        return;
+
+    for (int i = 0; i < run->count; i++)
+        texture_release(run->quads[i].page);
+
+    free(run->quads);
+    free(run);
+}
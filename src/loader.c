@@ -0,0 +1,592 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <errno.h>
+
+#define MAX_LOADER_THREADS 8
+
+Uint32 imageLoaderEvent = 0;
+
+static SDL_Thread *loaderThreads[MAX_LOADER_THREADS];
+static int loaderThreadCount = 0;
+
+// Each worker has its own queue, and each option's images go to one queue, so different
+// options decode in parallel. A worker takes from the head of its own queue, in the order
+// the images were drawn, and once that is empty steals from the tail of another, the work
+// furthest from being needed. The selected option's images jump all of them.
+//
+// Queue operations are a few pointer swaps next to a decode that takes milliseconds, so one
+// lock covers every queue.
+typedef struct _Loader_Queue
+{
+    Image_Job *head;
+    Image_Job *tail;
+} Loader_Queue;
+
+static SDL_mutex *loaderLock = NULL;
+static SDL_cond  *loaderWork = NULL;    // signalled when a job is queued or we are quitting.
+static SDL_cond  *loaderDone = NULL;    // signalled when a job has finished decoding.
+
+static Loader_Queue loaderQueues[MAX_LOADER_THREADS];
+static Loader_Queue loaderUrgent;
+static int loaderBatch = 0;             // which queue new jobs go to, see image_loader_batch().
+
+static Image_Job *doneHead    = NULL;
+static Image_Job *doneTail    = NULL;
+
+static int  loaderBusy = 0;             // jobs queued or being decoded.
+static bool loaderQuit = false;
+
+static int loaderSteals      = 0;
+static int loaderPrioritized = 0;
+static int loaderCancelled   = 0;
+
+// Only touched by image_loader_pump(), on the render thread.
+static int    imagesUploaded  = 0;
+static int    imagesResampled = 0;
+static Sint64 sourceTexels    = 0;
+static Sint64 uploadedTexels  = 0;
+
+
+static void image_job_decode(Image_Job *job)
+{   // Decode and convert to a format every renderer can take without a second conversion.
+    // The file was mapped when it was queued and is decoded from memory, SDL_image never touches the file itself.
+    File_Map *map = job->map;
+    SDL_Surface *imageSurface = NULL;
+
+    job->map = NULL;
+
+    // Like IMG_Load, the extension is a hint for formats without a signature, such as TGA.
+    const char *extension = strrchr(job->path, '.');
+
+    TRACE_BEGIN("IMG_Load", job->path);
+    imageSurface = IMG_LoadTyped_RW(SDL_RWFromConstMem(map->data, (int)map->size), 1, (extension != NULL) ? extension + 1 : NULL);
+    TRACE_END("IMG_Load");
+
+    file_map_release(map);
+
+    if (imageSurface == NULL)
+    {
+        fprintf(stderr, "IMG: Couldn't load %s: %s\n", job->path, IMG_GetError());
+    }
+    else if (imageSurface->format->format != SDL_PIXELFORMAT_ARGB8888)
+    {
+        SDL_Surface *convertedSurface = SDL_ConvertSurfaceFormat(imageSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+
+        if (convertedSurface != NULL)
+        {
+            SDL_FreeSurface(imageSurface);
+            imageSurface = convertedSurface;
+        }
+    }
+
+    if (imageSurface != NULL)
+    {
+        job->sourceWidth  = imageSurface->w;
+        job->sourceHeight = imageSurface->h;
+    }
+
+    // Shrink it to the size it will be drawn at, never enlarge, the GPU does that for free.
+    if (imageSurface != NULL && job->layoutSize != SIZE_ORIGINAL)
+    {
+        SDL_Rect target;
+        calculate_texture_size(imageSurface->w, imageSurface->h, &target, job->layoutSize, &job->layoutMargins);
+
+        if (target.w > 0 && target.h > 0 &&
+            target.w <= imageSurface->w && target.h <= imageSurface->h &&
+            (target.w < imageSurface->w || target.h < imageSurface->h))
+        {
+            TRACE_BEGIN("image_resample", job->path);
+            SDL_Surface *resampledSurface = image_resample(imageSurface, target.w, target.h);
+            TRACE_END("image_resample");
+
+            if (resampledSurface != NULL)
+            {
+                SDL_FreeSurface(imageSurface);
+                imageSurface = resampledSurface;
+            }
+        }
+    }
+
+    // The CPU compositor copies opaque rows instead of blending them, worth finding out here.
+    if (imageSurface != NULL && cpuCompositor)
+        job->opaque = compose_opaque(imageSurface);
+
+    job->surface = imageSurface;
+}
+
+
+static void loader_queue_push(Loader_Queue *queue, Image_Job *job)
+{
+    job->next  = NULL;
+    job->prev  = queue->tail;
+    job->queue = queue;
+
+    if (queue->tail == NULL)
+        queue->head = job;
+    else
+        queue->tail->next = job;
+
+    queue->tail = job;
+}
+
+
+static void loader_queue_remove(Image_Job *job)
+{
+    Loader_Queue *queue = job->queue;
+
+    if (job->prev == NULL)
+        queue->head = job->next;
+    else
+        job->prev->next = job->next;
+
+    if (job->next == NULL)
+        queue->tail = job->prev;
+    else
+        job->next->prev = job->prev;
+
+    job->next  = NULL;
+    job->prev  = NULL;
+    job->queue = NULL;
+}
+
+
+static void image_loader_wake()
+{   // Wake up the main loop so it can upload the texture.
+    SDL_Event event;
+    memset(&event, '\0', sizeof(event));
+    event.type = imageLoaderEvent;
+    SDL_PushEvent(&event);
+}
+
+
+static Image_Job *loader_take(int worker)
+{   // Call with loaderLock held. Urgent work first, then our own, then someone else's.
+    Image_Job *job = loaderUrgent.head;
+
+    if (job == NULL)
+        job = loaderQueues[worker].head;
+
+    for (int i = 1; job == NULL && i < loaderThreadCount; i++)
+    {
+        job = loaderQueues[(worker + i) % loaderThreadCount].tail;
+
+        if (job != NULL)
+            loaderSteals++;
+    }
+
+    if (job != NULL)
+        loader_queue_remove(job);
+
+    return job;
+}
+
+
+static int image_loader_thread(void *data)
+{
+    int worker = (int)(intptr_t)data;
+
+    SDL_LockMutex(loaderLock);
+
+    while (true)
+    {
+        Image_Job *job = NULL;
+
+        while (!loaderQuit && (job = loader_take(worker)) == NULL)
+            SDL_CondWait(loaderWork, loaderLock);
+
+        if (loaderQuit)
+            break;
+
+        SDL_UnlockMutex(loaderLock);
+
+        image_job_decode(job);
+
+        SDL_LockMutex(loaderLock);
+
+        if (doneTail == NULL)
+            doneHead = job;
+        else
+            doneTail->next = job;
+
+        doneTail = job;
+
+        SDL_CondBroadcast(loaderDone);
+        image_loader_wake();
+    }
+
+    SDL_UnlockMutex(loaderLock);
+
+    return 0;
+}
+
+
+static void image_job_free(Image_Job *job)
+{
+    file_map_release(job->map);
+
+    if (job->surface != NULL)
+        SDL_FreeSurface(job->surface);
+
+    free(job->path);
+    free(job);
+}
+
+
+void image_loader_init()
+{
+    imageLoaderEvent = SDL_RegisterEvents(1);
+
+    loaderLock = SDL_CreateMutex();
+    loaderWork = SDL_CreateCond();
+    loaderDone = SDL_CreateCond();
+    loaderQuit = false;
+
+    int threads = SDL_GetCPUCount();
+
+    if (threads < 1)
+        threads = 1;
+
+    if (threads > MAX_LOADER_THREADS)
+        threads = MAX_LOADER_THREADS;
+
+    for (int i = 0; i < threads; i++)
+    {
+        loaderThreads[loaderThreadCount] = SDL_CreateThread(&image_loader_thread, "image_loader", (void*)(intptr_t)i);
+
+        if (loaderThreads[loaderThreadCount] == NULL)
+        {
+            fprintf(stderr, "SDL_CreateThread Error: %s\n", SDL_GetError());
+            break;
+        }
+
+        // Workers already running read this when they look for something to steal.
+        SDL_LockMutex(loaderLock);
+        loaderThreadCount++;
+        SDL_UnlockMutex(loaderLock);
+    }
+}
+
+
+void image_loader_quit()
+{
+    SDL_LockMutex(loaderLock);
+    loaderQuit = true;
+    SDL_CondBroadcast(loaderWork);
+    SDL_UnlockMutex(loaderLock);
+
+    for (int i = 0; i < loaderThreadCount; i++)
+        SDL_WaitThread(loaderThreads[i], NULL);
+
+    loaderThreadCount = 0;
+
+    Image_Job *lists[MAX_LOADER_THREADS + 2];
+    int listCount = 0;
+
+    lists[listCount++] = doneHead;
+    lists[listCount++] = loaderUrgent.head;
+
+    for (int i = 0; i < MAX_LOADER_THREADS; i++)
+        lists[listCount++] = loaderQueues[i].head;
+
+    for (int i = 0; i < listCount; i++)
+    {
+        Image_Job *job = lists[i];
+
+        while (job != NULL)
+        {
+            Image_Job *next = job->next;
+
+            if (job->entry != NULL)
+                job->entry->job = NULL;
+
+            image_job_free(job);
+            job = next;
+        }
+    }
+
+    memset(loaderQueues, '\0', sizeof(loaderQueues));
+    memset(&loaderUrgent, '\0', sizeof(loaderUrgent));
+    doneHead    = doneTail    = NULL;
+    loaderBusy  = 0;
+
+    SDL_DestroyCond(loaderDone);
+    SDL_DestroyCond(loaderWork);
+    SDL_DestroyMutex(loaderLock);
+
+    loaderLock = NULL;
+    loaderWork = NULL;
+    loaderDone = NULL;
+}
+
+
+static bool image_probe(File_Map *map, const char *path)
+{   // Checks the signature, so image_fallback knows about a file that isn't an image before it's decoded.
+    typedef int (*Image_Check)(SDL_RWops *src);
+
+    static const Image_Check imageChecks[] = {
+        IMG_isBMP, IMG_isCUR, IMG_isGIF, IMG_isICO, IMG_isJPG, IMG_isLBM, IMG_isPCX, IMG_isPNG,
+        IMG_isPNM, IMG_isSVG, IMG_isTIF, IMG_isWEBP, IMG_isXCF, IMG_isXPM, IMG_isXV,
+#if SDL_IMAGE_VERSION_ATLEAST(2, 6, 0)
+        IMG_isAVIF, IMG_isJXL, IMG_isQOI,
+#endif
+    };
+
+    // TGA has no signature, IMG_Load goes by the extension for it too.
+    const char *extension = strrchr(path, '.');
+
+    if (extension != NULL && strcasecmp(extension, ".tga") == 0)
+        return true;
+
+    SDL_RWops *src = SDL_RWFromConstMem(map->data, (int)map->size);
+    bool known = false;
+
+    if (src == NULL)
+        return true;
+
+    for (size_t i = 0; !known && i < sizeof(imageChecks) / sizeof(imageChecks[0]); i++)
+        known = imageChecks[i](src);
+
+    SDL_RWclose(src);
+
+    return known;
+}
+
+
+bool image_loader_queue(Texture_Entry *entry, const SDL_Rect *margins)
+{   // Returns false if the file can't be opened or isn't an image, nothing is queued then.
+    // Mapping doesn't read it, the header is the only page touched here.
+    File_Map *map = file_map(entry->path, false);
+
+    if (map == NULL)
+    {
+        fprintf(stderr, "IMG: Couldn't open %s: %s\n", entry->path, strerror(errno));
+        return false;
+    }
+
+    if (!image_probe(map, entry->path))
+    {
+        fprintf(stderr, "IMG: %s isn't an image format SDL_image supports.\n", entry->path);
+        file_map_release(map);
+        return false;
+    }
+
+    Image_Job *job = (Image_Job*)ez_malloc(sizeof(Image_Job));
+
+    job->path  = strdup(entry->path);
+    job->map   = map;
+    job->entry = entry;
+    job->layoutSize = entry->layoutSize;
+    ASSIGN_RECT(job->layoutMargins, (*margins));
+
+    entry->job = job;
+
+    SDL_LockMutex(loaderLock);
+
+    if (loaderThreadCount == 0)
+    {   // No workers, decode it right here.
+        SDL_UnlockMutex(loaderLock);
+        image_job_decode(job);
+        SDL_LockMutex(loaderLock);
+
+        if (doneTail == NULL)
+            doneHead = job;
+        else
+            doneTail->next = job;
+
+        doneTail = job;
+        loaderBusy++;
+
+        SDL_UnlockMutex(loaderLock);
+
+        // Queued before the main loop starts, nothing else may wake it for the upload.
+        image_loader_wake();
+        return true;
+    }
+
+    loader_queue_push(&loaderQueues[loaderBatch % loaderThreadCount], job);
+    loaderBusy++;
+
+    // Any idle worker will do, it steals the job if it isn't in its own queue.
+    SDL_CondSignal(loaderWork);
+    SDL_UnlockMutex(loaderLock);
+
+    return true;
+}
+
+
+void image_loader_batch(int batch)
+{   // Jobs queued from now on share a queue, call it with the option index before building one.
+    loaderBatch = SDL_max(batch, 0);
+}
+
+
+void image_loader_prioritize(Texture_Entry *entry)
+{   // Moves a waiting decode in front of everything else, for the option on screen.
+    if (entry == NULL || entry->job == NULL)
+        return;
+
+    SDL_LockMutex(loaderLock);
+
+    Image_Job *job = entry->job;
+
+    if (job->queue != NULL && job->queue != &loaderUrgent)
+    {
+        loader_queue_remove(job);
+        loader_queue_push(&loaderUrgent, job);
+        loaderPrioritized++;
+    }
+
+    SDL_UnlockMutex(loaderLock);
+}
+
+
+void image_loader_cancel(Texture_Entry *entry)
+{   // A job nobody has started is dropped, one being decoded just forgets where the result was going.
+    Image_Job *job = entry->job;
+
+    if (job == NULL)
+        return;
+
+    entry->job = NULL;
+
+    if (loaderLock == NULL)
+    {
+        job->entry = NULL;
+        return;
+    }
+
+    SDL_LockMutex(loaderLock);
+
+    if (job->queue != NULL)
+    {
+        loader_queue_remove(job);
+        image_job_free(job);
+
+        loaderBusy--;
+        loaderCancelled++;
+    }
+    else
+    {
+        job->entry = NULL;
+    }
+
+    SDL_UnlockMutex(loaderLock);
+}
+
+
+int image_loader_pump()
+{   // Upload any finished decodes, must be called from the render thread.
+    SDL_LockMutex(loaderLock);
+    Image_Job *job = doneHead;
+    doneHead = doneTail = NULL;
+    SDL_UnlockMutex(loaderLock);
+
+    int uploaded = 0;
+
+    while (job != NULL)
+    {
+        Image_Job *next = job->next;
+        Texture_Entry *entry = job->entry;
+
+        if (entry != NULL)
+        {
+            entry->job = NULL;
+
+            if (job->surface != NULL)
+            {
+                SDL_Surface *surface = job->surface;
+
+                if (cpuCompositor)
+                {   // Nothing to upload, the compositor blends from the surface itself.
+                    entry->surface = surface;
+                    entry->opaque  = job->opaque;
+                    job->surface   = NULL;
+                }
+                else
+                {
+                    entry->texture = SDL_CreateTextureFromSurface(renderer, surface);
+                }
+
+                // Layout works from the source size, the texture just has fewer texels to fill it with.
+                entry->width   = job->sourceWidth;
+                entry->height  = job->sourceHeight;
+
+                if (!texture_ready(entry))
+                {
+                    fprintf(stderr, "SDL_CreateTextureFromSurface Error: %s: %s\n", job->path, SDL_GetError());
+                }
+                else
+                {
+                    uploaded++;
+
+                    if (entry->surface != NULL)
+                        texture_account_surface(entry);
+                    else
+                        texture_account(entry, entry->texture);
+
+                    imagesUploaded++;
+                    sourceTexels   += (Sint64)job->sourceWidth * job->sourceHeight;
+                    uploadedTexels += (Sint64)surface->w * surface->h;
+
+                    if (surface->w != job->sourceWidth || surface->h != job->sourceHeight)
+                        imagesResampled++;
+                }
+            }
+
+            entry->failed = !texture_ready(entry);
+        }
+
+        image_job_free(job);
+
+        SDL_LockMutex(loaderLock);
+        loaderBusy--;
+        SDL_UnlockMutex(loaderLock);
+
+        job = next;
+    }
+
+    return uploaded;
+}
+
+
+bool image_loader_busy()
+{
+    SDL_LockMutex(loaderLock);
+    bool busy = (loaderBusy > 0);
+    SDL_UnlockMutex(loaderLock);
+
+    return busy;
+}
+
+
+void image_loader_flush()
+{   // Block until every queued image has been decoded and uploaded.
+    SDL_LockMutex(loaderLock);
+
+    while (loaderBusy > 0)
+    {
+        while (doneHead == NULL)
+            SDL_CondWait(loaderDone, loaderLock);
+
+        SDL_UnlockMutex(loaderLock);
+        image_loader_pump();
+        SDL_LockMutex(loaderLock);
+    }
+
+    SDL_UnlockMutex(loaderLock);
+}
+
+
+void image_loader_stats()
+{
+    fprintf(stderr, "image_loader: %d workers, %d jobs stolen, %d prioritized, %d cancelled before decoding\n",
+        loaderThreadCount, loaderSteals, loaderPrioritized, loaderCancelled);
+
+    // Every image is drawn once a frame, so texels uploaded is also the texels sampled per frame.
+    fprintf(stderr, "image_resample: %d of %d images resampled, %lld -> %lld texels, %.1f -> %.1f MiB\n",
+        imagesResampled, imagesUploaded,
+        (long long)sourceTexels, (long long)uploadedTexels,
+        sourceTexels * 4 / 1048576.0, uploadedTexels * 4 / 1048576.0);
+}
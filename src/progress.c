@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+// A progress bar drawn over the scene. It isn't part of any display list, so an update
+// only changes two rectangles: no text is laid out and no layer is touched.
+//
+// The value comes from progress=<value>, a file that is re-read whenever it is written,
+// or a pipe/fd that sends one value per line. Values are a percentage, or n/m.
+
+#define PROGRESS_SCALE 10000        // values travel through SDL events as fixed point.
+
+Uint32 progressEvent = 0;
+
+static bool      progressEnabled  = false;
+static int       progressPosition = POS_BOTTOMCENTER;
+static SDL_Rect  progressMargins  = {0, 0, 0, 0};
+static int       progressWidth    = 0;      // 0 picks a size from the screen.
+static int       progressHeight   = 0;
+static int       progressValue    = 0;
+
+SDL_Color progressColor      = {255, 255, 255, 255};
+SDL_Color progressBackground = {64, 64, 64, 255};
+
+// What was drawn last, so an unchanged bar isn't damage.
+static SDL_Rect  progressDrawn    = {0, 0, 0, 0};
+static int       progressDrawnValue = -1;
+static SDL_Color progressDrawnColor[2];
+
+static char       *progressPath   = NULL;
+static int         progressFd     = -1;     // progress_fd=, it belongs to whoever started us.
+static int         progressPipe   = -1;     // a named pipe at progressPath, opened by us.
+static bool        progressStarted = false;
+static SDL_Thread *progressThread = NULL;
+static int         progressStop[2] = {-1, -1};
+
+
+static int progress_parse(const char *text)
+{   // "42", "42%", "42.5" or "3/8", returns 0 - PROGRESS_SCALE.
+    double done = 0, total = 0;
+    double value;
+
+    if (sscanf(text, " %lf / %lf", &done, &total) == 2 && total > 0)
+        value = done / total;
+    else if (sscanf(text, " %lf", &done) == 1)
+        value = done / 100.0;
+    else
+        return -1;
+
+    if (value < 0)
+        value = 0;
+
+    if (value > 1)
+        value = 1;
+
+    return (int)(value * PROGRESS_SCALE + 0.5);
+}
+
+
+static void progress_push(int value)
+{
+    if (value < 0)
+        return;
+
+    SDL_Event event;
+    memset(&event, '\0', sizeof(event));
+
+    event.type = progressEvent;
+    event.user.code = value;
+
+    SDL_PushEvent(&event);
+}
+
+
+static void progress_read_file()
+{   // The last number in the file wins.
+    int fd = open(progressPath, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return;
+
+    char buffer[256];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if (length <= 0)
+        return;
+
+    buffer[length] = '\0';
+
+    while (length > 0 && isspace((unsigned char)buffer[length - 1]))
+        buffer[--length] = '\0';
+
+    char *line = strrchr(buffer, '\n');
+
+    progress_push(progress_parse((line != NULL) ? line + 1 : buffer));
+}
+
+
+static void progress_watch_file()
+{   // Watch the directory, so files that are replaced by a rename are seen too.
+    char *slash = strrchr(progressPath, '/');
+    const char *name = (slash != NULL) ? slash + 1 : progressPath;
+    char *dir = (slash != NULL) ? ez_strcatn(NULL, progressPath, (slash == progressPath) ? 1 : slash - progressPath) : strdup(".");
+
+    int notify = inotify_init1(IN_CLOEXEC);
+
+    if (notify < 0 || inotify_add_watch(notify, dir, IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        fprintf(stderr, "progress: can't watch %s: %s\n", dir, strerror(errno));
+
+        if (notify >= 0)
+            close(notify);
+
+        free(dir);
+        return;
+    }
+
+    free(dir);
+
+    progress_read_file();
+
+    struct pollfd fds[2] = {{notify, POLLIN, 0}, {progressStop[0], POLLIN, 0}};
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR)
+    {
+        if (fds[1].revents)
+            break;
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        ssize_t length = read(notify, events, sizeof(events));
+        bool changed = false;
+
+        for (char *ptr = events; length > 0 && ptr < events + length; )
+        {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+
+            if (event->len > 0 && strcmp(event->name, name) == 0)
+                changed = true;
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (changed)
+            progress_read_file();
+    }
+
+    close(notify);
+}
+
+
+static void progress_watch_fd(int fd)
+{   // One value per line, only the newest one matters.
+    char buffer[256];
+    size_t used = 0;
+    struct pollfd fds[2] = {{fd, POLLIN, 0}, {progressStop[0], POLLIN, 0}};
+
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR)
+    {
+        if (fds[1].revents)
+            break;
+
+        if (!(fds[0].revents & (POLLIN | POLLHUP)))
+            continue;
+
+        ssize_t length = read(fd, buffer + used, sizeof(buffer) - used - 1);
+
+        if (length <= 0)
+            break;
+
+        used += length;
+        buffer[used] = '\0';
+
+        char *end = strrchr(buffer, '\n');
+
+        if (end == NULL)
+        {
+            if (used == sizeof(buffer) - 1)
+                used = 0;
+
+            continue;
+        }
+
+        *end = '\0';
+
+        char *line = strrchr(buffer, '\n');
+        progress_push(progress_parse((line != NULL) ? line + 1 : buffer));
+
+        used -= (end + 1) - buffer;
+        memmove(buffer, end + 1, used);
+    }
+}
+
+
+static int progress_thread(void *data)
+{   // The source can't change while this runs, progress_set_source() stops it first.
+    UNUSED(data);
+
+    if (progressFd >= 0)
+        progress_watch_fd(progressFd);
+    else if (progressPipe >= 0)
+        progress_watch_fd(progressPipe);
+    else
+        progress_watch_file();
+
+    return 0;
+}
+
+
+static bool progress_thread_start()
+{
+    if (progressPath == NULL && progressFd < 0)
+        return false;
+
+    struct stat info;
+
+    // A named pipe is read like an fd, opened read/write so writers coming and going isn't EOF.
+    if (progressFd < 0 && stat(progressPath, &info) == 0 && S_ISFIFO(info.st_mode))
+        progressPipe = open(progressPath, O_RDWR | O_CLOEXEC);
+
+    if (pipe(progressStop) != 0)
+    {
+        fprintf(stderr, "progress: pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    progressThread = SDL_CreateThread(&progress_thread, "progress", NULL);
+
+    if (progressThread == NULL)
+    {
+        fprintf(stderr, "SDL_CreateThread Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+
+static void progress_thread_stop()
+{
+    if (progressThread != NULL)
+    {
+        if (write(progressStop[1], "", 1) < 0)
+            fprintf(stderr, "progress: %s\n", strerror(errno));
+
+        SDL_WaitThread(progressThread, NULL);
+        progressThread = NULL;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (progressStop[i] >= 0)
+            close(progressStop[i]);
+
+        progressStop[i] = -1;
+    }
+
+    if (progressPipe >= 0)
+        close(progressPipe);
+
+    progressPipe = -1;
+}
+
+
+void progress_set_value(const char *value)
+{
+    int parsed = progress_parse(value);
+
+    if (parsed >= 0)
+        progressValue = parsed;
+
+    progressEnabled = true;
+}
+
+
+void progress_set_source(const char *path, int fd)
+{   // Templates and daemon lines can change the source at any time, the watcher is
+    // stopped before its path goes and started again on the new one.
+    progressEnabled = true;
+
+    // Every option's template may set the same one, that doesn't need a restart.
+    if (fd == progressFd &&
+        ((path == NULL && progressPath == NULL) || (path != NULL && progressPath != NULL && strcmp(path, progressPath) == 0)))
+        return;
+
+    progress_thread_stop();
+
+    free(progressPath);
+    progressPath = (path != NULL) ? strdup(path) : NULL;
+    progressFd = fd;
+
+    if (progressStarted)
+        progress_thread_start();
+}
+
+
+void progress_set_layout(int position, int width, int height)
+{   // Negative values are left alone. Margins are taken from when the bar was placed, like text and images.
+    if (position >= 0)
+        progressPosition = position;
+
+    if (width >= 0)
+        progressWidth = width;
+
+    if (height >= 0)
+        progressHeight = height;
+
+    ASSIGN_RECT(progressMargins, globalMargins);
+}
+
+
+bool progress_start()
+{   // The event is registered even without a source yet, one can still be set later.
+    progressEvent = SDL_RegisterEvents(1);
+    progressStarted = true;
+
+    return progress_thread_start();
+}
+
+
+bool progress_event(SDL_Event *event)
+{   // Returns true if the bar needs drawing again.
+    if (event->user.code == progressValue)
+        return false;
+
+    progressValue = event->user.code;
+    return progressEnabled;
+}
+
+
+static bool progress_rect(SDL_Rect *bar)
+{
+    if (!progressEnabled)
+        return false;
+
+    bar->w = (progressWidth > 0) ? progressWidth : screenWidth / 2;
+    bar->h = (progressHeight > 0) ? progressHeight : SDL_max(4, screenHeight / 40);
+
+    calculate_texture_rect(bar, progressPosition, &progressMargins);
+    return true;
+}
+
+
+static bool color_equal(SDL_Color a, SDL_Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+
+void progress_damage(SDL_Rect *damage)
+{   // Adds where the bar was and where it is now, if anything about it changed.
+    SDL_Rect bar = {0, 0, 0, 0};
+    progress_rect(&bar);
+
+    if (progressDrawnValue == progressValue && SDL_RectEquals(&bar, &progressDrawn) &&
+        color_equal(progressDrawnColor[0], progressColor) && color_equal(progressDrawnColor[1], progressBackground))
+        return;
+
+    SDL_Rect rects[2] = {progressDrawn, bar};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (SDL_RectEmpty(&rects[i]))
+            continue;
+
+        if (SDL_RectEmpty(damage))
+            *damage = rects[i];
+        else
+            SDL_UnionRect(damage, &rects[i], damage);
+    }
+
+    progressDrawn = bar;
+    progressDrawnValue = progressValue;
+    progressDrawnColor[0] = progressColor;
+    progressDrawnColor[1] = progressBackground;
+}
+
+
+void progress_draw()
+{
+    SDL_Rect bar;
+
+    if (!progress_rect(&bar))
+        return;
+
+    SDL_SetRenderDrawColor(renderer, progressBackground.r, progressBackground.g, progressBackground.b, 255);
+    SDL_RenderFillRect(renderer, &bar);
+
+    bar.w = (int)((Sint64)bar.w * progressValue / PROGRESS_SCALE);
+
+    if (bar.w > 0)
+    {
+        SDL_SetRenderDrawColor(renderer, progressColor.r, progressColor.g, progressColor.b, 255);
+        SDL_RenderFillRect(renderer, &bar);
+    }
+}
+
+
+void progress_quit()
+{
+    progress_thread_stop();
+    progressStarted = false;
+
+    free(progressPath);
+    progressPath = NULL;
+}
@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+// Box filter downscaling for ARGB8888 surfaces, done once on a loader thread so the
+// GPU only ever samples a texture the size it is drawn at.
+//
+// Both passes are plain integer multiply-adds over contiguous arrays, which the
+// compiler vectorizes. Colour is premultiplied while filtering, so transparent
+// pixels don't bleed their (usually black) colour into the edges.
+
+#define H_WEIGHT_BITS 16    // horizontal weights sum to 1 << 16, output is 8.8 fixed point.
+#define V_WEIGHT_BITS 15    // vertical weights sum to 1 << 15, keeps the sums inside 32 bits.
+
+typedef struct _Resample_Axis
+{
+    int    *start;      // first source pixel for each output pixel.
+    int    *count;      // how many source pixels it covers.
+    Uint32 *weights;    // `count` weights per output pixel, packed.
+    int    *offset;     // where each output pixel's weights start.
+} Resample_Axis;
+
+
+static void resample_axis_init(Resample_Axis *axis, int srcSize, int dstSize, int weightBits)
+{   // Every output pixel averages the source pixels it covers, weighted by how much of each.
+    double scale = (double)srcSize / dstSize;
+    int maxCount = (int)scale + 2;
+
+    axis->start   = (int*)ez_malloc(dstSize * sizeof(int));
+    axis->count   = (int*)ez_malloc(dstSize * sizeof(int));
+    axis->offset  = (int*)ez_malloc(dstSize * sizeof(int));
+    axis->weights = (Uint32*)ez_malloc((size_t)dstSize * maxCount * sizeof(Uint32));
+
+    Uint32 total = 1u << weightBits;
+    int used = 0;
+
+    for (int i = 0; i < dstSize; i++)
+    {
+        double left  = i * scale;
+        double right = (i + 1) * scale;
+        int first = (int)left;
+        int last  = (int)right;
+
+        if (last >= srcSize || (double)last == right)
+            last--;
+
+        if (last < first)
+            last = first;
+
+        axis->start[i]  = first;
+        axis->count[i]  = last - first + 1;
+        axis->offset[i] = used;
+
+        Uint32 sum = 0;
+
+        for (int j = first; j <= last; j++)
+        {
+            double from = (j > left) ? j : left;
+            double to   = (j + 1 < right) ? j + 1 : right;
+            Uint32 weight = (Uint32)((to - from) / scale * total + 0.5);
+
+            axis->weights[used + j - first] = weight;
+            sum += weight;
+        }
+
+        // Rounding can leave it a little off, the centre pixel takes the difference.
+        axis->weights[used + (last - first) / 2] += total - sum;
+
+        used += axis->count[i];
+    }
+}
+
+
+static void resample_axis_free(Resample_Axis *axis)
+{
+    free(axis->start);
+    free(axis->count);
+    free(axis->offset);
+    free(axis->weights);
+}
+
+
+SDL_Surface *image_resample(SDL_Surface *surface, int width, int height)
+{   // Returns a new ARGB8888 surface of width x height, `surface` is left alone.
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888 ||
+        width < 1 || height < 1 || width > surface->w || height > surface->h)
+    {
+        return NULL;
+    }
+
+    SDL_Surface *result = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+
+    if (result == NULL)
+        return NULL;
+
+    Resample_Axis columns;
+    Resample_Axis rows;
+
+    resample_axis_init(&columns, surface->w, width, H_WEIGHT_BITS);
+    resample_axis_init(&rows, surface->h, height, V_WEIGHT_BITS);
+
+    // Horizontal pass: every source row shrinks to `width` premultiplied 8.8 pixels.
+    int stride = width * 4;
+    Uint16 *narrow = (Uint16*)ez_malloc((size_t)surface->h * stride * sizeof(Uint16));
+
+    for (int y = 0; y < surface->h; y++)
+    {
+        const Uint32 *src = (const Uint32*)((const Uint8*)surface->pixels + (size_t)y * surface->pitch);
+        Uint16 *out = narrow + (size_t)y * stride;
+
+        for (int x = 0; x < width; x++)
+        {
+            const Uint32 *weight = columns.weights + columns.offset[x];
+            const Uint32 *pixel = src + columns.start[x];
+            Uint32 acc[4] = {0, 0, 0, 0};
+
+            for (int k = 0; k < columns.count[x]; k++)
+            {
+                Uint32 p = pixel[k];
+                Uint32 a = p >> 24;
+
+                // c * a / 255, close enough and no division.
+                acc[0] += weight[k] * ((((p      ) & 0xff) * a * 257 + 32768) >> 16);
+                acc[1] += weight[k] * ((((p >>  8) & 0xff) * a * 257 + 32768) >> 16);
+                acc[2] += weight[k] * ((((p >> 16) & 0xff) * a * 257 + 32768) >> 16);
+                acc[3] += weight[k] * a;
+            }
+
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (Uint16)((acc[c] + (1 << (H_WEIGHT_BITS - 9))) >> (H_WEIGHT_BITS - 8));
+        }
+    }
+
+    // Vertical pass: blend whole rows at a time, this is where most of the work is.
+    Uint32 *acc = (Uint32*)ez_malloc(stride * sizeof(Uint32));
+
+    for (int y = 0; y < height; y++)
+    {
+        const Uint32 *weight = rows.weights + rows.offset[y];
+
+        memset(acc, '\0', stride * sizeof(Uint32));
+
+        for (int k = 0; k < rows.count[y]; k++)
+        {
+            const Uint16 *in = narrow + (size_t)(rows.start[y] + k) * stride;
+            Uint32 w = weight[k];
+
+            for (int i = 0; i < stride; i++)
+                acc[i] += w * in[i];
+        }
+
+        Uint32 *dst = (Uint32*)((Uint8*)result->pixels + (size_t)y * result->pitch);
+        const int shift = V_WEIGHT_BITS + 8;
+        const Uint32 round = 1u << (shift - 1);
+
+        for (int x = 0; x < width; x++)
+        {
+            Uint32 a = (acc[x * 4 + 3] + round) >> shift;
+
+            if (a == 0)
+            {
+                dst[x] = 0;
+                continue;
+            }
+
+            Uint32 b = (acc[x * 4 + 0] + round) >> shift;
+            Uint32 g = (acc[x * 4 + 1] + round) >> shift;
+            Uint32 r = (acc[x * 4 + 2] + round) >> shift;
+
+            if (a < 255)
+            {   // Back to straight alpha.
+                b = SDL_min(255, (b * 255 + a / 2) / a);
+                g = SDL_min(255, (g * 255 + a / 2) / a);
+                r = SDL_min(255, (r * 255 + a / 2) / a);
+            }
+
+            dst[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    free(acc);
+    free(narrow);
+
+    resample_axis_free(&columns);
+    resample_axis_free(&rows);
+
+    return result;
+}
@@ -2,10 +2,24 @@
 
 #include "sdl2imgshow.h"
 
-Image_Object *global_image = NULL;
-Image_Object *root_image = NULL;
+Display_List *global_list = NULL;
+Display_List *root_list = NULL;
 Option_List *root_option = NULL;
 
+// Options in file order, with an open addressing hash from id to index.
+static Option_List **optionArray = NULL;
+static int optionCount = 0;
+static int optionCapacity = 0;
+static int *optionHash = NULL;
+static int optionHashSize = 0;
+
+#define OPTION_PAGE_SIZE     10
+#define OPTION_REPEAT_DELAY  400    // ms a direction is held before it repeats.
+#define OPTION_REPEAT_START  150    // first repeat interval, every repeat is a bit quicker.
+#define OPTION_REPEAT_FAST   25
+#define OPTION_TRIGGER_DOWN  16384
+#define OPTION_TRIGGER_UP    8192
+
 int screenWidth   = 640;
 int screenHeight  = 480;
 
@@ -51,22 +65,45 @@ bool keypressQuit = false;    // wait until 30 presses have been done to quit
 
 bool wantQuiet    = false;    // wait quietly
 
+bool lazyOptions  = false;    // only build options near the cursor
+bool showStats    = false;    // print cache statistics on exit
+
+bool compositeLayers = true;  // flatten static scenes into a single texture
+static int compositeGeneration = 1;
+static int compositesBuilt = 0;
+
+static Damage_Item *presentedItems = NULL;     // what is on screen, one per layer.
+static int presentedCount = 0;
+static int presentedCapacity = 0;
+static bool damageAll = true;
+static int layersCulled = 0;
+static Sint64 damagePixels = 0;
+
+static Uint32 optionClock = 0;
+static int optionEvictions = 0;
+
+static int windowWidth  = 0;        // --size, 0 for fullscreen.
+static int windowHeight = 0;
+
 SDL_Window   *window   = NULL;
 SDL_Renderer *renderer = NULL;
+bool softwarePresent   = false;     // renderer draws into the window surface, frames present only what changed.
 
 const char *displayTemplate = NULL;
-
-char processWatchCmd[1024] = "";
-bool processWatch = false;
+Ini_Program *displayProgram = NULL;
+Ini_Program *iniRecord = NULL;      // while set, ini_parse records lines instead of running them.
 
 
 void save_state(system_state *state);
 void restore_state(system_state *state);
+static Option_List *option_for_button(int button);
+static SDL_Renderer *software_renderer_create(SDL_Renderer *accelerated);
+static void size_args(int *argc, char *argv[]);
 
 void print_usage()
 {
     // generate with: grep '//= -\w' src/sdl2imgshow.c | cut -d'=' -f 2- | cut -d':' -f 1 | while read line; printf " [$line]"; end; echo ""
-    fprintf(stderr, "Usage: [ -z <config_file>] [ -T <display_template>] [ -F <game_id>] [ -G <option_file.ini>] [ -i <image_file>] [ -a <text_alignment>] [ -f <font_file>] [ -t <text>] [ -c <colour>] [ -P <image_positon>] [ -S <image_stretch>] [ -s <font_size>] [ -p <text_position>] [ -d <shadow_color>] [ -o <shadow_offset>] [ -D] [ -q] [ -k] [ -W] [ -W] [ -O] [ -b <process_name>] [ -x <key=value>]\n\n");
+    fprintf(stderr, "Usage: [ -z <config_file>] [ -T <display_template>] [ -F <game_id>] [ -G <option_file.ini>] [ -i <image_file>] [ -a <text_alignment>] [ -f <font_file>] [ -t <text>] [ -c <colour>] [ -P <image_positon>] [ -S <image_stretch>] [ -s <font_size>] [ -p <text_position>] [ -d <shadow_color>] [ -o <shadow_offset>] [ -D] [ -q] [ -k] [ -W] [ -W] [ -O] [ -L] [ -R] [ -v] [ -b <process_name>] [ -C <cache_dir>] [ -M <megabytes>] [ -N <count>] [ -x <key=value>] [ --trace <file>] [ --size <w>x<h>] [ --listen <path>] [ --send <path> [line ...]]\n\n");
 
     // generate with: grep '//= -\w' src/sdl2imgshow.c | cut -d'=' -f 2- | while read line; echo "        \"   $line\n\""; end
     fprintf(stderr,
@@ -92,9 +129,19 @@ void print_usage()
         "    -W:                        wait quit mode.\n"
         "    -W:                        quiet mode.\n"
         "    -O:                        disable font scaling to screen size.\n"
-        "    -b <process_name>:         watch for process_name, quit if it is running.\n"
+        "    -L:                        lazy option mode, only load options near the selected one.\n"
+        "    -R:                        without a GPU, draw with SDL's software renderer instead of the built-in compositor.\n"
+        "    -v:                        print cache statistics on exit.\n"
+        "    -b <process_name>:         watch for process_name, quit if it is running. Can be used more than once.\n"
+        "    -C <cache_dir>:            cache the finished frame in cache_dir, later runs with the same setup just show it.\n"
+        "    -M <megabytes>:            texture memory budget for option mode, least recently used options are unloaded.\n"
+        "    -N <count>:                step to the next option count times once each frame is complete, then quit. For benchmarking.\n"
         "    -x <key=value>:            set a variable, the value supports variable substitution.\n"
         "    -X <key=value>:            set a variable, the value doesn't support variable substitution.\n"
+        "    --trace <file>:            write a Chrome trace of startup to file.\n"
+        "    --size <w>x<h>:            use a window this size instead of the whole screen, for testing and benchmarks.\n"
+        "    --listen <path>:           keep running and take commands from a unix socket or named pipe at path.\n"
+        "    --send <path> [line ...]:  send lines, or stdin, to a running --listen and exit.\n"
         "\n\n"
         );
 
@@ -105,6 +152,7 @@ void print_usage()
         "text_position=<position>: sets the position of images loaded.\n"
         "image_stretch=<stretch>: Sets the stretch mode of images loaded.\n"
         "text_position=<position>: sets the position of the text rendered to the screen from now on.\n"
+        "text_align=<alignment>: sets the alignment of multi-line text, left, center or right.\n"
         "screen_margin=<x>,<y>,<w>,<h>: Sets the margin for anything loaded from now on.\n"
         "font=<font_file>: Load a font file.\n"
         "font_fallback=<font_file>: Load a font if the previous font or font_fallback failed to load.\n"
@@ -121,6 +169,20 @@ void print_usage()
         "set=<key>=<value>: Sets a variable, allows variable substitution.\n"
         "set_strict=<key>=<value>: Sets a variable, does not allow variable substitution.\n"
         "disable_font_scale=<bool>: Enables/Disables font scaling to screen height. true = disable\n"
+        "lazy_options=<bool>: Enables/Disables lazy option mode, only options near the selected one are loaded.\n"
+        "font_cache_size=<count>: Sets how many font/size combinations are kept open.\n"
+        "stats=<bool>: Enables/Disables printing cache statistics on exit.\n"
+        "watch_process=<name>: Quit once a process with this name is running, can be used more than once.\n"
+        "watch_match=<match>: How watch_process names are matched, substring or exact.\n"
+        "composite_layers=<bool>: Enables/Disables flattening the finished scene into a single texture.\n"
+        "texture_budget=<megabytes>: Unloads the least recently used options when textures use more than this, 0 for no limit.\n"
+        "progress=<percent>: Shows the progress bar with this value, a percentage or <n>/<total>.\n"
+        "progress_position=<position>: Sets the position of the progress bar, uses the current screen_margin.\n"
+        "progress_size=<w>,<h>: Sets the size of the progress bar in pixels.\n"
+        "progress_color=<r>,<g>,<b>: Sets the colour of the filled part of the progress bar.\n"
+        "progress_background=<r>,<g>,<b>: Sets the colour of the empty part of the progress bar.\n"
+        "progress_file=<file>: Shows the progress bar, its value is read again each time file is written. A named pipe takes one value per line.\n"
+        "progress_fd=<fd>: Shows the progress bar, its value is read from an inherited fd, one value per line.\n"
         "\n\n"
         );
 }
@@ -130,12 +192,26 @@ int main(int argc, char *argv[])
 {
     char tempBuff[40];
 
+    //= --trace <file>: write a Chrome trace of startup to file.
+    trace_args(&argc, argv);
+
+    //= --size <w>x<h>: use a window this size instead of the whole screen, for testing and benchmarks.
+    size_args(&argc, argv);
+
+    //= --listen <path>: keep running and take commands from a unix socket or named pipe at path.
+    //= --send <path> [line ...]: send lines, or stdin, to a running --listen and exit.
+    daemon_args(&argc, argv);
+
+    TRACE_BEGIN("sdl_do_init", NULL);
+
     if (sdl_do_init() != 0)
     {
         sdl_do_quit();
         return 255;
     }
 
+    TRACE_END("sdl_do_init");
+
     // Get screen resolution
     SDL_DisplayMode dm;
     if (SDL_GetCurrentDisplayMode(0, &dm) != 0)
@@ -145,8 +221,8 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    screenWidth  = dm.w;
-    screenHeight = dm.h;
+    screenWidth  = (windowWidth > 0) ? windowWidth : dm.w;
+    screenHeight = (windowHeight > 0) ? windowHeight : dm.h;
 
     snprintf(tempBuff, sizeof(tempBuff), "%d", screenWidth);
     set_var("width", tempBuff);
@@ -157,7 +233,7 @@ int main(int argc, char *argv[])
     // Create window
     window = SDL_CreateWindow("SDL2 Image Show",
         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        screenWidth, screenHeight, SDL_WINDOW_FULLSCREEN);
+        screenWidth, screenHeight, (windowWidth > 0) ? 0 : SDL_WINDOW_FULLSCREEN);
 
     if (window == NULL)
     {
@@ -167,7 +243,10 @@ int main(int argc, char *argv[])
     }
 
     // Create renderer
+    TRACE_BEGIN("SDL_CreateRenderer", NULL);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    renderer = software_renderer_create(renderer);
+    TRACE_END("SDL_CreateRenderer");
     if (renderer == NULL)
     {
         SDL_DestroyWindow(window);
@@ -183,8 +262,14 @@ int main(int argc, char *argv[])
     bool option_select_mode=false;
     const char *option_select_file=NULL;
     const char *default_select=NULL;
+    int auto_navigate=-1;
+    bool sdlSoftware=false;
+
+    // Everything from the command line and config files is recorded and run afterwards,
+    // so the bake cache can skip loading anything when it already has the frame.
+    iniRecord = (Ini_Program*)ez_malloc(sizeof(Ini_Program));
 
-    while (!finished && (opt = getopt(argc, argv, "ODqkwWz:i:f:t:c:s:d:o:a:S:p:b:T:F:G:x:X:")) != -1)
+    while (!finished && (opt = getopt(argc, argv, "ODLRvqkwWz:i:f:t:c:s:d:o:a:S:p:b:C:M:N:T:F:G:x:X:")) != -1)
     {
         switch (opt)
         {
@@ -193,6 +278,21 @@ int main(int argc, char *argv[])
             ini_read(optarg, &ini_parse, NULL);
             break;
 
+        case 'C':
+            //= -C <cache_dir>: cache the finished frame in cache_dir, later runs with the same setup just show it.
+            bakeCacheDir=optarg;
+            break;
+
+        case 'M':
+            //= -M <megabytes>: texture memory budget for option mode, least recently used options are unloaded.
+            ini_parse(NULL, "texture_budget", optarg);
+            break;
+
+        case 'N':
+            //= -N <count>: step to the next option count times once each frame is complete, then quit. For benchmarking.
+            auto_navigate=atoi(optarg);
+            break;
+
         case 'T':
             //= -T <display_template>: display template for game select mode
             displayTemplate=optarg;
@@ -294,20 +394,34 @@ int main(int argc, char *argv[])
             ini_parse(NULL, "disable_font_scale", "y");
             break;
 
+        case 'L':
+            //= -L: lazy option mode, only load options near the selected one.
+            ini_parse(NULL, "lazy_options", "y");
+            break;
+
+        case 'R':
+            //= -R: without a GPU, draw with SDL's software renderer instead of the built-in compositor.
+            sdlSoftware=true;
+            break;
+
+        case 'v':
+            //= -v: print cache statistics on exit.
+            ini_parse(NULL, "stats", "y");
+            break;
+
         case 'b':
-            //= -b <process_name>: watch for process_name, quit if it is running.
-            snprintf(processWatchCmd, sizeof(processWatchCmd), "pgrep '%s'", optarg);
-            processWatch = true;
+            //= -b <process_name>: watch for process_name, quit if it is running. Can be used more than once.
+            ini_parse(NULL, "watch_process", optarg);
             break;
 
         case 'x':
             //= -x <key=value>: set a variable, the value supports variable substitution.
-            var_set_parse(optarg, true);
+            ini_parse(NULL, "set", optarg);
             break;
 
         case 'X':
             //- -X <key=value>: set a variable, the value doesn't support variable substitution.
-            var_set_parse(optarg, false);
+            ini_parse(NULL, "set_strict", optarg);
             break;
 
         default: /* '?' */
@@ -316,9 +430,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    Ini_Program *startupProgram = iniRecord;
+    iniRecord = NULL;
+
     // Check if required arguments are provided
     if (finished == true)
     {
+        ini_program_free(startupProgram);
         print_usage();
 
         image_quit();
@@ -329,6 +447,18 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    // Without a GPU, images and glyphs are blended on the CPU straight into the window surface.
+    if (softwarePresent && !sdlSoftware)
+        compose_init(SDL_GetWindowSurface(window));
+
+    // A bake cache hit only needs the settings, the frame is already finished.
+    if (bakeCacheDir != NULL && !option_select_mode && bake_restore(startupProgram))
+        ini_run_settings(startupProgram);
+    else
+        ini_run(startupProgram);
+
+    ini_program_free(startupProgram);
+
     if (option_select_mode)
     {
         if (displayTemplate == NULL)
@@ -355,7 +485,7 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;
         }
 
-        if (root_option == NULL)
+        if (optionCount == 0)
         {
             print_usage();
 
@@ -367,28 +497,15 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;            
         }
 
-        if (default_select != NULL)
-        {
-            Option_List *current_opt = root_option;
-            Option_List *first_opt = root_option;
+        Option_List *default_opt = NULL;
 
-            do
-            {
-                if (strcasecmp(current_opt->id, default_select) == 0)
-                    break;
+        if (default_select != NULL)
+            default_opt = option_find(default_select);
 
-                current_opt = current_opt->next;
-            } while (current_opt != first_opt);
+        if (default_opt == NULL)
+            default_opt = option_at(0);
 
-            root_option = current_opt;
-            root_image = root_option->image_object;
-        }
-        else
-        {
-            // By default it will be on the last option, so go to the head (next).
-            root_option = root_option->next;
-            root_image = root_option->image_object;
-        }
+        option_select(default_opt);
 
         fprintf(stderr, "= %s\n", root_option->id);
     }
@@ -402,12 +519,141 @@ int main(int argc, char *argv[])
     SDL_Event event;
     int quit = 0;
     bool doneRender = false;
+    bool sceneDirty = true;
+    bool barDirty = false;
     int keypressQuitCount = 0;
 
+    // A daemon stays up for more commands, whatever the startup options said.
+    if (daemon_start())
+        wantQuit = false;
+
+    // Quitting straight away, so the one frame we draw has to be complete.
+    if (wantQuit)
+        image_loader_flush();
+
+    process_watch_start();
+    progress_start();
+
+    Uint32 loopStart = SDL_GetTicks();
+    int frameCount = 0;
+    int idleWakeups = 0;
+    bool navigating = false;
+
+    int heldButton = SDL_CONTROLLER_BUTTON_INVALID;
+    Uint32 nextRepeat = 0;
+    int repeatInterval = OPTION_REPEAT_START;
+    bool triggerDown[2] = {false, false};
+
     // Wait for quit event
     while (!quit)
     {
-        while (SDL_PollEvent(&event) && !quit)
+        // A progress update redraws even a finished quiet frame, the composite makes that one copy.
+        if ((sceneDirty && !doneRender) || barDirty)
+        {
+            // fprintf(stderr, "loop\n");
+            // Clear screen
+            // SDL_RenderClear(renderer);
+
+            // Only what changed since the last present is drawn, a software renderer pushes just that
+            // to the window. Anything else has to redraw the whole frame, but still skips unchanged ones.
+            SDL_Rect damage = {0, 0, 0, 0};
+            SDL_Rect screen = {0, 0, screenWidth, screenHeight};
+
+            // In daemon mode this is what the last present committed, not the scene lines are building.
+            Display_List *scene = daemon_scene();
+
+            display_list_damage(scene, &damage);
+            progress_damage(&damage);
+
+            if (SDL_IntersectRect(&damage, &screen, &damage))
+            {
+                // Render Textures
+                TRACE_BEGIN("display_list_draw", NULL);
+                display_list_draw(scene, softwarePresent ? &damage : NULL);
+                TRACE_END("display_list_draw");
+
+                // Reading back has to happen before present, the back buffer is undefined after it.
+                if (bakeCacheDir != NULL && !image_loader_busy())
+                    bake_capture();
+
+                // Drawn over the scene and after the bake, it changes without the scene changing.
+                progress_draw();
+
+                // Update screen
+                if (frameCount == 0)
+                    TRACE_BEGIN("first_present", NULL);
+
+                SDL_RenderPresent(renderer);
+
+                if (softwarePresent)
+                {
+                    SDL_RenderSetClipRect(renderer, NULL);
+                    SDL_UpdateWindowSurfaceRects(window, &damage, 1);
+                }
+
+                if (frameCount == 0)
+                    TRACE_END("first_present");
+
+                frameCount++;
+                damagePixels += (Sint64)damage.w * damage.h;
+            }
+
+            // Quiet mode only draws once everything has loaded.
+            doneRender = wantQuiet && !image_loader_busy();
+
+            if (navigating && !image_loader_busy())
+            {
+                TRACE_END("navigate");
+                navigating = false;
+            }
+        }
+
+        sceneDirty = false;
+        barDirty = false;
+
+        if (wantQuit == true)
+            break;
+
+        if (auto_navigate >= 0 && !navigating && !image_loader_busy())
+        {   // -N: the last frame was complete, move on by ourselves.
+            if (auto_navigate == 0 || !option_select_mode)
+                break;
+
+            auto_navigate--;
+            navigating = true;
+
+            TRACE_BEGIN("navigate", option_at(root_option->index + 1)->id);
+            option_select(option_at(root_option->index + 1));
+
+            sceneDirty = true;
+            continue;
+        }
+
+        // Sleep until something happens, or until a held direction is due to repeat.
+        int gotEvent;
+
+        if (heldButton != SDL_CONTROLLER_BUTTON_INVALID)
+        {
+            Uint32 now = SDL_GetTicks();
+            int timeout = SDL_TICKS_PASSED(now, nextRepeat) ? 0 : (int)(nextRepeat - now);
+
+            gotEvent = SDL_WaitEventTimeout(&event, timeout);
+
+            if (!gotEvent)
+            {
+                option_select(option_for_button(heldButton));
+                sceneDirty = true;
+
+                repeatInterval = SDL_max(OPTION_REPEAT_FAST, repeatInterval * 4 / 5);
+                nextRepeat = SDL_GetTicks() + repeatInterval;
+            }
+        }
+        else
+        {
+            gotEvent = SDL_WaitEvent(&event);
+        }
+
+        while (gotEvent && !quit)
         {
             switch (event.type)
             {
@@ -417,22 +663,19 @@ int main(int argc, char *argv[])
                 if (keypressQuit && keypressQuitCount > 30)
                     quit = 1;
 
-                if (option_select_mode)
+                if (option_select_mode && option_for_button(event.cbutton.button) != NULL)
+                {   // Directions and shoulders move, and keep moving while held.
+                    option_select(option_for_button(event.cbutton.button));
+                    sceneDirty = true;
+
+                    heldButton = event.cbutton.button;
+                    repeatInterval = OPTION_REPEAT_START;
+                    nextRepeat = SDL_GetTicks() + OPTION_REPEAT_DELAY;
+                }
+                else if (option_select_mode)
                 {
                     switch (event.cbutton.button)
                     {
-                    case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
-                    case SDL_CONTROLLER_BUTTON_DPAD_UP:
-                        root_option = root_option->prev;
-                        root_image = root_option->image_object;
-                        break;
-
-                    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
-                    case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
-                        root_option = root_option->next;
-                        root_image = root_option->image_object;
-                        break;
-
                     case SDL_CONTROLLER_BUTTON_A:
                         printf("%s\n", root_option->id);
                         quit = 1;
@@ -446,11 +689,34 @@ int main(int argc, char *argv[])
                 break;
 
             case SDL_CONTROLLERBUTTONUP:
+                if (event.cbutton.button == heldButton)
+                    heldButton = SDL_CONTROLLER_BUTTON_INVALID;
+
                 if (waitQuit)
                     quit = 1;
 
                 break;
 
+            case SDL_CONTROLLERAXISMOTION:
+                if (option_select_mode &&
+                    (event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT ||
+                     event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT))
+                {   // Triggers jump to the next or previous first letter.
+                    int trigger = (event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT);
+
+                    if (!triggerDown[trigger] && event.caxis.value > OPTION_TRIGGER_DOWN)
+                    {
+                        triggerDown[trigger] = true;
+                        option_select(option_letter(root_option, trigger ? 1 : -1));
+                        sceneDirty = true;
+                    }
+                    else if (triggerDown[trigger] && event.caxis.value < OPTION_TRIGGER_UP)
+                    {
+                        triggerDown[trigger] = false;
+                    }
+                }
+                break;
+
             case SDL_CONTROLLERDEVICEADDED:
                 {
                     SDL_GameControllerOpen(event.cdevice.which);
@@ -458,6 +724,9 @@ int main(int argc, char *argv[])
                 break;
             case SDL_CONTROLLERDEVICEREMOVED:
                 {
+                    // It can't send the button up any more.
+                    heldButton = SDL_CONTROLLER_BUTTON_INVALID;
+
                     SDL_GameController* controller = SDL_GameControllerFromInstanceID(event.cdevice.which);
                     if (controller)
                     {
@@ -466,53 +735,97 @@ int main(int argc, char *argv[])
                 }
                 break;
 
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    display_list_invalidate_all();
+
+                if (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    display_damage_all();
+                    sceneDirty = true;
+                }
+
+                break;
+
+            case SDL_RENDER_TARGETS_RESET:
+            case SDL_RENDER_DEVICE_RESET:
+                // Render target contents are gone.
+                display_list_invalidate_all();
+                sceneDirty = true;
+                break;
+
             case SDL_QUIT:
                 quit = 1;
                 break;
-            }
-        }
 
-        Image_Object *current = root_image;
-
-        if (!doneRender)
-        {
-            // fprintf(stderr, "loop\n");
-            // Clear screen
-            // SDL_RenderClear(renderer);
+            default:
+                if (event.type == processWatchEvent)
+                    quit = 1;
 
-            // Render Textures
-            while (current != NULL)
-            {   
-                // fprintf(stderr, "- %p\n", current);
+                if (event.type == progressEvent && progress_event(&event))
+                    barDirty = true;
 
-                if (current->imageTexture != NULL)
+                if (event.type == daemonEvent)
                 {
-                    SDL_SetTextureColorMod(
-                        current->imageTexture,
-                        current->drawColor.r, current->drawColor.g, current->drawColor.b);
+                    switch (daemon_command(&event))
+                    {
+                    case DAEMON_PRESENT:
+                        sceneDirty = true;
+                        doneRender = false;
+                        break;
 
-                    SDL_RenderCopy(renderer, current->imageTexture, NULL, &current->imageRect);
+                    case DAEMON_QUIT:
+                        quit = 1;
+                        break;
+                    }
                 }
 
-                current = current->next;
+                break;
             }
 
-            // Update screen
-            SDL_RenderPresent(renderer);
-            doneRender = wantQuiet;
+            gotEvent = SDL_PollEvent(&event);
         }
 
-        // 10 frames a second is fine.
-        SDL_Delay(100);
-
-        if (wantQuit == true)
-            break;
-
-        if (processWatch)
+        // Upload anything the loader threads have finished with.
+        if (image_loader_pump() > 0)
         {
-            if (system(processWatchCmd) == 0)
-                break;
+            sceneDirty = true;
+            doneRender = false;
+
+            // Texture sizes are only known once they are uploaded.
+            if (option_select_mode)
+                option_evict();
         }
+
+        if (!sceneDirty)
+            idleWakeups++;
+    }
+
+    process_watch_quit();
+    progress_quit();
+    daemon_quit();
+
+    if (showStats)
+    {
+        float seconds = (SDL_GetTicks() - loopStart) / 1000.0f;
+
+        fprintf(stderr, "main_loop: %d frames, %d idle wakeups in %.1fs (%.2f/s)\n",
+            frameCount, idleWakeups, seconds, (seconds > 0.0f) ? idleWakeups / seconds : 0.0f);
+    }
+
+    if (showStats)
+    {
+        font_cache_stats();
+        image_loader_stats();
+        asset_io_stats();
+        texture_memory_stats();
+        fprintf(stderr, "option_evict: %d options evicted\n", optionEvictions);
+        fprintf(stderr, "composite: %d scenes flattened\n", compositesBuilt);
+        compose_stats();
+        fprintf(stderr, "damage: %.1f%% of the screen redrawn per frame, %d layers culled%s\n",
+            (frameCount > 0) ? 100.0 * damagePixels / ((double)frameCount * screenWidth * screenHeight) : 0.0,
+            layersCulled, softwarePresent ? "" : " (full frames, not a software renderer)");
     }
 
     // Clean up
@@ -527,6 +840,61 @@ int main(int argc, char *argv[])
 }
 
 
+static void size_args(int *argc, char *argv[])
+{   // Pulls --size <w>x<h> out of argv, the window has to exist before getopt runs.
+    int out = 1;
+
+    for (int i = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < *argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth <= 0 || windowHeight <= 0)
+            {
+                fprintf(stderr, "--size: expected <w>x<h>, got %s\n", argv[i]);
+                windowWidth = windowHeight = 0;
+            }
+
+            continue;
+        }
+
+        argv[out++] = argv[i];
+    }
+
+    argv[out] = NULL;
+    *argc = out;
+}
+
+
+static SDL_Renderer *software_renderer_create(SDL_Renderer *accelerated)
+{   // SDL's own software renderer presents the whole window every frame, draw into the window
+    // surface ourselves instead so only the damaged part is pushed out.
+    if (accelerated != NULL)
+    {
+        SDL_RendererInfo info;
+
+        if (SDL_GetRendererInfo(accelerated, &info) != 0 || !(info.flags & SDL_RENDERER_SOFTWARE))
+            return accelerated;
+
+        SDL_DestroyRenderer(accelerated);
+    }
+
+    SDL_Surface *surface = SDL_GetWindowSurface(window);
+
+    if (surface == NULL)
+    {
+        fprintf(stderr, "SDL_GetWindowSurface Error: %s\n", SDL_GetError());
+        return NULL;
+    }
+
+    SDL_Renderer *result = SDL_CreateSoftwareRenderer(surface);
+
+    if (result != NULL)
+        softwarePresent = true;
+
+    return result;
+}
+
+
 static int sdl_status = 0;
 
 int sdl_do_init()
@@ -574,11 +942,7 @@ void sdl_do_quit()
 
     if (sdl_status > 2)
     {
-        if (globalFont != NULL)
-        {
-            TTF_CloseFont(globalFont);
-            globalFont = NULL;
-        }
+        font_cache_quit();
 
         TTF_Quit();
     }
@@ -654,128 +1018,516 @@ void var_set_parse(const char *text, bool var_sub)
 }
 
 
-void ini_parse(void *state, const char *key, const char *value)
-{   // Callback for INI parsing, also used in getopt.
-    UNUSED(state);
+static const struct
+{
+    const char *key;
+    int op;
+} iniOps[] = {
+    {"image",              INI_IMAGE},
+    {"image_fallback",     INI_IMAGE_FALLBACK},
+    {"image_position",     INI_IMAGE_POSITION},
+    {"image_stretch",      INI_IMAGE_STRETCH},
+    {"text_position",      INI_TEXT_POSITION},
+    {"text_align",         INI_TEXT_ALIGN},
+    {"screen_margin",      INI_SCREEN_MARGIN},
+    {"font",               INI_FONT},
+    {"font_fallback",      INI_FONT_FALLBACK},
+    {"font_size",          INI_FONT_SIZE},
+    {"text",               INI_TEXT},
+    {"text_color",         INI_TEXT_COLOR},
+    {"shadow_color",       INI_SHADOW_COLOR},
+    {"shadow_offset",      INI_SHADOW_OFFSET},
+    {"shadow",             INI_SHADOW},
+    {"quiet",              INI_QUIET},
+    {"quit",               INI_QUIT},
+    {"wait_quit",          INI_WAIT_QUIT},
+    {"keypress_quit",      INI_KEYPRESS_QUIT},
+    {"set",                INI_SET},
+    {"set_strict",         INI_SET_STRICT},
+    {"disable_font_scale", INI_DISABLE_FONT_SCALE},
+    {"lazy_options",       INI_LAZY_OPTIONS},
+    {"font_cache_size",    INI_FONT_CACHE_SIZE},
+    {"stats",              INI_STATS},
+    {"watch_process",      INI_WATCH_PROCESS},
+    {"watch_match",        INI_WATCH_MATCH},
+    {"composite_layers",   INI_COMPOSITE_LAYERS},
+    {"texture_budget",     INI_TEXTURE_BUDGET},
+    {"progress",           INI_PROGRESS},
+    {"progress_position",  INI_PROGRESS_POSITION},
+    {"progress_size",      INI_PROGRESS_SIZE},
+    {"progress_color",     INI_PROGRESS_COLOR},
+    {"progress_background", INI_PROGRESS_BACKGROUND},
+    {"progress_file",      INI_PROGRESS_FILE},
+    {"progress_fd",        INI_PROGRESS_FD},
+};
+
+
+void ini_compile_line(Ini_Instr *instr, const char *key, const char *value)
+{   // Resolve the key and pre-parse the value, so running it later is just a switch.
+    memset(instr, '\0', sizeof(Ini_Instr));
+
+    instr->op    = INI_UNKNOWN;
+    instr->key   = strdup(key);
+    instr->value = strdup(value);
+
+    for (size_t i = 0; i < sizeof(iniOps) / sizeof(iniOps[0]); i++)
+    {
+        if (strcasecmp(key, iniOps[i].key) == 0)
+        {
+            instr->op = iniOps[i].op;
+            break;
+        }
+    }
+
+    int *f = instr->fields;
+
+    switch (instr->op)
+    {
+    case INI_IMAGE:
+    case INI_IMAGE_FALLBACK:
+    case INI_FONT:
+    case INI_FONT_FALLBACK:
+    case INI_TEXT:
+        instr->tmpl = template_compile(value);
+        break;
+
+    case INI_IMAGE_POSITION:
+    case INI_TEXT_POSITION:
+    case INI_PROGRESS_POSITION:
+        instr->number = get_positon(value);
+        break;
+
+    case INI_IMAGE_STRETCH:
+        instr->number = get_image_size(value);
+        break;
+
+    case INI_TEXT_ALIGN:
+        instr->number = get_text_align(value);
+        break;
+
+    case INI_SCREEN_MARGIN:
+        instr->parsed = sscanf(value, "%d,%d,%d,%d", &f[0], &f[1], &f[2], &f[3]);
+        break;
+
+    case INI_TEXT_COLOR:
+    case INI_SHADOW_COLOR:
+    case INI_PROGRESS_COLOR:
+    case INI_PROGRESS_BACKGROUND:
+        instr->parsed = sscanf(value, "%d,%d,%d", &f[0], &f[1], &f[2]);
+        break;
+
+    case INI_SHADOW_OFFSET:
+    case INI_PROGRESS_SIZE:
+        instr->parsed = sscanf(value, "%d,%d", &f[0], &f[1]);
+        break;
+
+    case INI_FONT_SIZE:
+    case INI_FONT_CACHE_SIZE:
+    case INI_TEXTURE_BUDGET:
+    case INI_PROGRESS_FD:
+        instr->number = atoi(value);
+        break;
+
+    case INI_SHADOW:
+    case INI_QUIET:
+    case INI_QUIT:
+    case INI_WAIT_QUIT:
+    case INI_KEYPRESS_QUIT:
+    case INI_DISABLE_FONT_SCALE:
+    case INI_LAZY_OPTIONS:
+    case INI_STATS:
+        instr->number = bool_parse(value, false);
+        break;
+
+    case INI_COMPOSITE_LAYERS:
+        instr->number = bool_parse(value, true);
+        break;
+
+    case INI_WATCH_MATCH:
+        instr->number = (strcasecmp(value, "exact") == 0);
+        break;
+
+    case INI_SET:
+    case INI_SET_STRICT:
+        {
+            const char *delimiter = strchr(value, '=');
+
+            if (delimiter == NULL)
+                break;
 
-    if (strcasecmp(key, "image") == 0)
-    {   //: image=<image_file>: Load an image.
-        imageFallback = ! load_image(value);
+            instr->name = ez_strcatn(NULL, value, delimiter - value);
+
+            if (instr->op == INI_SET)
+                instr->tmpl = template_compile(delimiter + 1);
+            else
+                instr->tmpl = NULL;
+        }
+        break;
     }
-    else if (strcasecmp(key, "image_fallback") == 0)
-    {   //: image_fallback=<image_file>: Load an image if the previous image or image_fallback failed to load.
+}
+
+
+void ini_free_line(Ini_Instr *instr)
+{
+    template_free(instr->tmpl);
+    free(instr->name);
+    free(instr->key);
+    free(instr->value);
+}
+
+
+static Uint8 color_field(int value)
+{
+    return (Uint8)value;
+}
+
+
+void ini_exec(const Ini_Instr *instr)
+{
+    const int *f = instr->fields;
+    char *ref = NULL;
+
+    // Substitute variables for the keys that take them.
+    if (instr->tmpl != NULL)
+        ref = template_eval(instr->tmpl);
+
+    switch (instr->op)
+    {
+    case INI_IMAGE:
+        //: image=<image_file>: Load an image.
+        imageFallback = ! load_image(ref);
+        break;
+
+    case INI_IMAGE_FALLBACK:
+        //: image_fallback=<image_file>: Load an image if the previous image or image_fallback failed to load.
         if (imageFallback)
-            imageFallback = ! load_image(value);
-    }
-    else if (strcasecmp(key, "image_position") == 0)
-    {   //: text_position=<position>: sets the position of images loaded.
-        imagePosition = get_positon(value);
-    }
-    else if (strcasecmp(key, "image_stretch") == 0)
-    {   //: image_stretch=<stretch>: Sets the stretch mode of images loaded.
-        imageSize = get_image_size(value);
-    }
-    else if (strcasecmp(key, "text_position") == 0)
-    {   //: text_position=<position>: sets the position of the text rendered to the screen from now on.
-        textPosition = get_positon(value);
-    }
-    else if (strcasecmp(key, "screen_margin") == 0)
-    {   //: screen_margin=<x>,<y>,<w>,<h>: Sets the margin for anything loaded from now on.
-        sscanf(value, "%d,%d,%d,%d", &globalMargins.x, &globalMargins.y, &globalMargins.w, &globalMargins.h);
-    }
-    else if (strcasecmp(key, "font") == 0)
-    {   //: font=<font_file>: Load a font file.
-        fontFallback = ! load_font(value);
-    }
-    else if (strcasecmp(key, "font_fallback") == 0)
-    {   //: font_fallback=<font_file>: Load a font if the previous font or font_fallback failed to load.
+            imageFallback = ! load_image(ref);
+        break;
+
+    case INI_IMAGE_POSITION:
+        //: text_position=<position>: sets the position of images loaded.
+        imagePosition = instr->number;
+        break;
+
+    case INI_IMAGE_STRETCH:
+        //: image_stretch=<stretch>: Sets the stretch mode of images loaded.
+        imageSize = instr->number;
+        break;
+
+    case INI_TEXT_POSITION:
+        //: text_position=<position>: sets the position of the text rendered to the screen from now on.
+        textPosition = instr->number;
+        break;
+
+    case INI_TEXT_ALIGN:
+        //: text_align=<alignment>: sets the alignment of multi-line text, left, center or right.
+        textAlignment = instr->number;
+        break;
+
+    case INI_SCREEN_MARGIN:
+        //: screen_margin=<x>,<y>,<w>,<h>: Sets the margin for anything loaded from now on.
+        if (instr->parsed > 0) globalMargins.x = f[0];
+        if (instr->parsed > 1) globalMargins.y = f[1];
+        if (instr->parsed > 2) globalMargins.w = f[2];
+        if (instr->parsed > 3) globalMargins.h = f[3];
+        break;
+
+    case INI_FONT:
+        //: font=<font_file>: Load a font file.
+        fontFallback = ! load_font(ref);
+        break;
+
+    case INI_FONT_FALLBACK:
+        //: font_fallback=<font_file>: Load a font if the previous font or font_fallback failed to load.
         if (fontFallback)
-            fontFallback = ! load_font(value);
-    }
-    else if (strcasecmp(key, "font_size") == 0)
-    {   //: font_size=<size>: Sets the font size, if any fonts are loaded they will be reloaded with this size.
-        font_size(atoi(value));
-    }
-    else if (strcasecmp(key, "text") == 0)
-    {   //: text=<text>: Renders text using the current font, font size, font color and shadow settings.
-        render_text(value);
-    }
-    else if (strcasecmp(key, "text_color") == 0)
-    {   //: text_color=<r>,<g>,<b>: Sets the text colour to r,g,b.
-        sscanf(value, "%hhu,%hhu,%hhu", &textColor.r, &textColor.g, &textColor.b);
-    }
-    else if (strcasecmp(key, "shadow_color") == 0)
-    {   //: shadow_color=<r>,<g>,<b>: Sets the drop shadow colour to r,g,b. Enables drop shadows.
-        sscanf(value, "%hhu,%hhu,%hhu", &dropShadowColor.r, &dropShadowColor.g, &dropShadowColor.b);
+            fontFallback = ! load_font(ref);
+        break;
+
+    case INI_FONT_SIZE:
+        //: font_size=<size>: Sets the font size, if any fonts are loaded they will be reloaded with this size.
+        font_size(instr->number);
+        break;
+
+    case INI_TEXT:
+        //: text=<text>: Renders text using the current font, font size, font color and shadow settings.
+        render_text(ref);
+        break;
+
+    case INI_TEXT_COLOR:
+        //: text_color=<r>,<g>,<b>: Sets the text colour to r,g,b.
+        if (instr->parsed > 0) textColor.r = color_field(f[0]);
+        if (instr->parsed > 1) textColor.g = color_field(f[1]);
+        if (instr->parsed > 2) textColor.b = color_field(f[2]);
+        break;
+
+    case INI_SHADOW_COLOR:
+        //: shadow_color=<r>,<g>,<b>: Sets the drop shadow colour to r,g,b. Enables drop shadows.
+        if (instr->parsed > 0) dropShadowColor.r = color_field(f[0]);
+        if (instr->parsed > 1) dropShadowColor.g = color_field(f[1]);
+        if (instr->parsed > 2) dropShadowColor.b = color_field(f[2]);
         dropShadow=true;
-    }
-    else if (strcasecmp(key, "shadow_offset") == 0)
-    {   //: shadow=<int>,<int>: Sets the offset of the dropshadow by x/y. Enables drop shadows.
-        sscanf(value, "%d,%d", &dropShadowOffset.x, &dropShadowOffset.y);
+        break;
+
+    case INI_SHADOW_OFFSET:
+        //: shadow=<int>,<int>: Sets the offset of the dropshadow by x/y. Enables drop shadows.
+        if (instr->parsed > 0) dropShadowOffset.x = f[0];
+        if (instr->parsed > 1) dropShadowOffset.y = f[1];
         dropShadow=true;
-    }
-    else if (strcasecmp(key, "shadow") == 0)
-    {   //: shadow=<bool>: Enable/Disable drop shadow for rendered text
-        dropShadow = bool_parse(value, false);
-    }
-    else if (strcasecmp(key, "quiet") == 0)
-    {   //: quiet=<bool>: Enable/Disable wait quiet mode.
-        wantQuiet = bool_parse(value, false);
-    }
-    else if (strcasecmp(key, "quit") == 0)
-    {   //: quit=<bool>: Enable/Disable wait quit mode.
-        wantQuit = bool_parse(value, false);
-    }
-    else if (strcasecmp(key, "wait_quit") == 0)
-    {   //: wait_quit=<bool>: Enable/Disable wait quit mode.
-        waitQuit = bool_parse(value, false);
-    }
-    else if (strcasecmp(key, "keypress_quit") == 0)
-    {   //: keypress_quit=<bool>: Enables/Disables keypress_quit mode
-        keypressQuit = bool_parse(value, false);
-    }
-    else if (strcasecmp(key, "set") == 0)
-    {   //: set=<key>=<value>: Sets a variable, allows variable substitution.
-        var_set_parse(value, true);
-    }
-    else if (strcasecmp(key, "set_strict") == 0)
-    {   //: set_strict=<key>=<value>: Sets a variable, does not allow variable substitution.
-        var_set_parse(value, false);
-    }
-    else if (strcasecmp(key, "disable_font_scale") == 0)
-    {   //: disable_font_scale=<bool>: Enables/Disables font scaling to screen height. true = disable
-        disableFontScale = bool_parse(value, false);
+        break;
+
+    case INI_SHADOW:
+        //: shadow=<bool>: Enable/Disable drop shadow for rendered text
+        dropShadow = instr->number;
+        break;
+
+    case INI_QUIET:
+        //: quiet=<bool>: Enable/Disable wait quiet mode.
+        wantQuiet = instr->number;
+        break;
+
+    case INI_QUIT:
+        //: quit=<bool>: Enable/Disable wait quit mode.
+        wantQuit = instr->number;
+        break;
+
+    case INI_WAIT_QUIT:
+        //: wait_quit=<bool>: Enable/Disable wait quit mode.
+        waitQuit = instr->number;
+        break;
+
+    case INI_KEYPRESS_QUIT:
+        //: keypress_quit=<bool>: Enables/Disables keypress_quit mode
+        keypressQuit = instr->number;
+        break;
+
+    case INI_SET:
+    case INI_SET_STRICT:
+        //: set=<key>=<value>: Sets a variable, allows variable substitution.
+        //: set_strict=<key>=<value>: Sets a variable, does not allow variable substitution.
+        if (instr->name == NULL)
+            fprintf(stderr, "Error: No '=' found in the input text \"%s\"\n", instr->value);
+        else if (ref != NULL)
+            set_var(instr->name, ref);
+        else
+            set_var(instr->name, strchr(instr->value, '=') + 1);
+        break;
+
+    case INI_DISABLE_FONT_SCALE:
+        //: disable_font_scale=<bool>: Enables/Disables font scaling to screen height. true = disable
+        disableFontScale = instr->number;
 
         if (globalFontName != NULL)
             load_font(globalFontName);
-    }
-    else
-    {
-        fprintf(stderr, "Unknown INI: %s = %s\n", key, value);
-    }
+        break;
+
+    case INI_LAZY_OPTIONS:
+        //: lazy_options=<bool>: Enables/Disables lazy option mode, only options near the selected one are loaded.
+        lazyOptions = instr->number;
+        break;
+
+    case INI_FONT_CACHE_SIZE:
+        //: font_cache_size=<count>: Sets how many font/size combinations are kept open.
+        fontCacheSize = instr->number;
+
+        if (fontCacheSize < 1)
+            fontCacheSize = 1;
+
+        font_cache_trim();
+        break;
+
+    case INI_STATS:
+        //: stats=<bool>: Enables/Disables printing cache statistics on exit.
+        showStats = instr->number;
+        break;
+
+    case INI_WATCH_PROCESS:
+        //: watch_process=<name>: Quit once a process with this name is running, can be used more than once.
+        process_watch_add(instr->value);
+        break;
+
+    case INI_WATCH_MATCH:
+        //: watch_match=<match>: How watch_process names are matched, substring or exact.
+        processWatchExact = instr->number;
+        break;
+
+    case INI_COMPOSITE_LAYERS:
+        //: composite_layers=<bool>: Enables/Disables flattening the finished scene into a single texture.
+        compositeLayers = instr->number;
+        break;
+
+    case INI_TEXTURE_BUDGET:
+        //: texture_budget=<megabytes>: Unloads the least recently used options when textures use more than this, 0 for no limit.
+        textureBudget = (Sint64)SDL_max(instr->number, 0) * 1048576;
+        break;
+
+    case INI_PROGRESS:
+        //: progress=<percent>: Shows the progress bar with this value, a percentage or <n>/<total>.
+        progress_set_value(instr->value);
+        break;
+
+    case INI_PROGRESS_POSITION:
+        //: progress_position=<position>: Sets the position of the progress bar, uses the current screen_margin.
+        progress_set_layout(instr->number, -1, -1);
+        break;
+
+    case INI_PROGRESS_SIZE:
+        //: progress_size=<w>,<h>: Sets the size of the progress bar in pixels.
+        progress_set_layout(-1, (instr->parsed > 0) ? f[0] : -1, (instr->parsed > 1) ? f[1] : -1);
+        break;
+
+    case INI_PROGRESS_COLOR:
+        //: progress_color=<r>,<g>,<b>: Sets the colour of the filled part of the progress bar.
+        if (instr->parsed > 0) progressColor.r = color_field(f[0]);
+        if (instr->parsed > 1) progressColor.g = color_field(f[1]);
+        if (instr->parsed > 2) progressColor.b = color_field(f[2]);
+        break;
+
+    case INI_PROGRESS_BACKGROUND:
+        //: progress_background=<r>,<g>,<b>: Sets the colour of the empty part of the progress bar.
+        if (instr->parsed > 0) progressBackground.r = color_field(f[0]);
+        if (instr->parsed > 1) progressBackground.g = color_field(f[1]);
+        if (instr->parsed > 2) progressBackground.b = color_field(f[2]);
+        break;
+
+    case INI_PROGRESS_FILE:
+        //: progress_file=<file>: Shows the progress bar, its value is read again each time file is written. A named pipe takes one value per line.
+        progress_set_source(instr->value, -1);
+        break;
+
+    case INI_PROGRESS_FD:
+        //: progress_fd=<fd>: Shows the progress bar, its value is read from an inherited fd, one value per line.
+        progress_set_source(NULL, instr->number);
+        break;
+
+    default:
+        fprintf(stderr, "Unknown INI: %s = %s\n", instr->key, instr->value);
+        break;
+    }
+
+    free(ref);
 }
 
 
-void save_state(system_state *state)
+static void ini_compile_callback(void *state, const char *key, const char *value)
 {
-    state->imageSize     = imageSize;
-    state->imagePosition = imagePosition;
-    state->textPosition  = textPosition;
-    state->textAlignment = textAlignment;
-    state->fontSize      = fontSize;
+    Ini_Program *program = (Ini_Program*)state;
 
-    state->dropShadow       = dropShadow;
-    state->disableFontScale = disableFontScale;
+    if (program->count == program->capacity)
+    {
+        program->capacity = (program->capacity == 0) ? 32 : program->capacity * 2;
+        program->instrs = (Ini_Instr*)realloc(program->instrs, program->capacity * sizeof(Ini_Instr));
 
-    if (globalFontName != NULL)
-        state->globalFontName = strdup(globalFontName);
-    else
-        state->globalFontName = NULL;
+        if (program->instrs == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory. :(\n");
+            exit(255);
+        }
+    }
 
-    ASSIGN_RECT(state->globalMargins,     globalMargins);
-    ASSIGN_COLOR(state->textColor,        textColor);
-    ASSIGN_COLOR(state->dropShadowColor,  dropShadowColor);
-    ASSIGN_POINT(state->dropShadowOffset, dropShadowOffset);
+    ini_compile_line(&program->instrs[program->count++], key, value);
+}
+
+
+void ini_parse(void *state, const char *key, const char *value)
+{   // Callback for INI parsing, also used in getopt.
+    UNUSED(state);
+
+    if (iniRecord != NULL)
+    {   // Run later, see main().
+        ini_compile_callback(iniRecord, key, value);
+        return;
+    }
+
+    Ini_Instr instr;
+
+    ini_compile_line(&instr, key, value);
+    ini_exec(&instr);
+    ini_free_line(&instr);
+}
+
+
+Ini_Program *ini_compile(const char *filename)
+{   // Read an INI file once, it can then be run as many times as needed.
+    Ini_Program *program = (Ini_Program*)ez_malloc(sizeof(Ini_Program));
+
+    if (ini_read(filename, &ini_compile_callback, program))
+    {
+        ini_program_free(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+
+void ini_run(const Ini_Program *program)
+{
+    for (int i = 0; i < program->count; i++)
+        ini_exec(&program->instrs[i]);
+}
+
+
+bool ini_op_draws(int op)
+{   // Anything that loads or draws, as opposed to settings and variables.
+    switch (op)
+    {
+    case INI_IMAGE:
+    case INI_IMAGE_FALLBACK:
+    case INI_FONT:
+    case INI_FONT_FALLBACK:
+    case INI_FONT_SIZE:
+    case INI_DISABLE_FONT_SCALE:
+    case INI_TEXT:
+        return true;
+    }
+
+    return false;
+}
+
+
+void ini_run_settings(const Ini_Program *program)
+{   // Used when the frame came out of the bake cache, so nothing needs loading.
+    for (int i = 0; i < program->count; i++)
+    {
+        if (!ini_op_draws(program->instrs[i].op))
+            ini_exec(&program->instrs[i]);
+    }
+}
+
+
+void ini_program_free(Ini_Program *program)
+{
+    if (program == NULL)
+        return;
+
+    for (int i = 0; i < program->count; i++)
+        ini_free_line(&program->instrs[i]);
+
+    free(program->instrs);
+    free(program);
+}
+
+
+void save_state(system_state *state)
+{
+    state->imageSize     = imageSize;
+    state->imagePosition = imagePosition;
+    state->textPosition  = textPosition;
+    state->textAlignment = textAlignment;
+    state->fontSize      = fontSize;
+
+    state->dropShadow       = dropShadow;
+    state->disableFontScale = disableFontScale;
+
+    if (globalFontName != NULL)
+        state->globalFontName = strdup(globalFontName);
+    else
+        state->globalFontName = NULL;
+
+    ASSIGN_RECT(state->globalMargins,     globalMargins);
+    ASSIGN_COLOR(state->textColor,        textColor);
+    ASSIGN_COLOR(state->dropShadowColor,  dropShadowColor);
+    ASSIGN_POINT(state->dropShadowOffset, dropShadowOffset);
 }
 
 void restore_state(system_state *state)
@@ -802,15 +1554,189 @@ void restore_state(system_state *state)
 }
 
 
+static Uint32 option_hash(const char *id)
+{   // FNV-1a over the case-folded id, ids are matched case insensitively.
+    Uint32 hash = 2166136261u;
+
+    while (*id)
+    {
+        hash ^= (Uint8)SDL_tolower((unsigned char)*id++);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+static void option_hash_insert(Option_List *option)
+{   // Kept at most half full. The first option with an id wins, like the old list walk.
+    if ((optionCount * 2) > optionHashSize)
+    {
+        free(optionHash);
+
+        optionHashSize = (optionHashSize == 0) ? 128 : optionHashSize * 2;
+        optionHash = (int*)ez_malloc(optionHashSize * sizeof(int));
+
+        for (int i = 0; i < optionHashSize; i++)
+            optionHash[i] = -1;
+
+        for (int i = 0; i < optionCount; i++)
+        {
+            if (optionArray[i] != option)
+                option_hash_insert(optionArray[i]);
+        }
+    }
+
+    Uint32 slot = option_hash(option->id) & (optionHashSize - 1);
+
+    while (optionHash[slot] != -1)
+    {
+        if (strcasecmp(optionArray[optionHash[slot]]->id, option->id) == 0)
+            return;
+
+        slot = (slot + 1) & (optionHashSize - 1);
+    }
+
+    optionHash[slot] = option->index;
+}
+
+
+Option_List *option_find(const char *id)
+{
+    if (optionHashSize == 0)
+        return NULL;
+
+    Uint32 slot = option_hash(id) & (optionHashSize - 1);
+
+    while (optionHash[slot] != -1)
+    {
+        Option_List *option = optionArray[optionHash[slot]];
+
+        if (strcasecmp(option->id, id) == 0)
+            return option;
+
+        slot = (slot + 1) & (optionHashSize - 1);
+    }
+
+    return NULL;
+}
+
+
+Option_List *option_at(int index)
+{   // Wraps around in both directions.
+    if (optionCount == 0)
+        return NULL;
+
+    index %= optionCount;
+
+    if (index < 0)
+        index += optionCount;
+
+    return optionArray[index];
+}
+
+
+Option_List *option_letter(Option_List *option, int direction)
+{   // The first option of the next (or previous) run of ids starting with another letter.
+    int letter = SDL_tolower((unsigned char)option->id[0]);
+
+    for (int step = 1; step < optionCount; step++)
+    {
+        Option_List *candidate = option_at(option->index + step * direction);
+        int other = SDL_tolower((unsigned char)candidate->id[0]);
+
+        if (other == letter)
+            continue;
+
+        if (direction < 0)
+        {   // Going back lands on the start of that letter, not its end.
+            while (step + 1 < optionCount &&
+                SDL_tolower((unsigned char)option_at(option->index - step - 1)->id[0]) == other)
+            {
+                step++;
+            }
+
+            candidate = option_at(option->index - step);
+        }
+
+        return candidate;
+    }
+
+    return option;
+}
+
+
+static Option_List *option_for_button(int button)
+{   // Where a direction or shoulder button goes from the current option, NULL for other buttons.
+    switch (button)
+    {
+    case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+    case SDL_CONTROLLER_BUTTON_DPAD_UP:
+        return option_at(root_option->index - 1);
+
+    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+    case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+        return option_at(root_option->index + 1);
+
+    case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+        return option_at(root_option->index - OPTION_PAGE_SIZE);
+
+    case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+        return option_at(root_option->index + OPTION_PAGE_SIZE);
+    }
+
+    return NULL;
+}
+
+
 void option_parse(void *state, const char *key, const char *value)
 {
     UNUSED(state);
 
-    set_var("id", key);
+    Option_List *option_item = (Option_List*)ez_malloc(sizeof(Option_List));
+
+    if (optionCount == optionCapacity)
+    {
+        optionCapacity = (optionCapacity == 0) ? 64 : optionCapacity * 2;
+        optionArray = (Option_List**)realloc(optionArray, optionCapacity * sizeof(Option_List*));
+
+        if (optionArray == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory. :(\n");
+            exit(255);
+        }
+    }
+
+    option_item->id    = strdup(key);
+    option_item->vars  = strdup(value);
+    option_item->index = optionCount;
 
-    char *new_value = strdup(value);
+    optionArray[optionCount++] = option_item;
+
+    option_hash_insert(option_item);
+
+    // In lazy mode the option is only built once it gets close to the cursor.
+    if (!lazyOptions)
+        option_load(option_item);
+}
+
+
+void option_load(Option_List *option)
+{
+    if (option->loaded)
+        return;
+
+    // The option's own variables only live while its template is evaluated.
+    push_vars();
+
+    set_var("id", option->id);
+
+    char *new_value = strdup(option->vars);
     if (new_value == NULL)
+    {
+        pop_vars();
         return;
+    }
 
     char *token = strtok(new_value, ";;");
 
@@ -824,158 +1750,154 @@ void option_parse(void *state, const char *key, const char *value)
 
     free(new_value);
 
-    Option_List *option_item = (Option_List*)ez_malloc(sizeof(Option_List));
+    Display_List *old_root = root_list;
+    root_list = display_list_clone(global_list);
 
-    if (root_option == NULL)
-    {
-        // If the list is empty, initialize the root_option
-        root_option = option_item;
-        option_item->next = option_item;
-        option_item->prev = option_item;
-    }
-    else
-    {
-        // Insert the new item at the end of the doubly linked list
-        Option_List *last = root_option->prev; // Get the last item in the list
+    // The template is only read and parsed once, every option just replays it.
+    if (displayProgram == NULL)
+        displayProgram = ini_compile(displayTemplate);
 
-        // Set the new item pointers
-        option_item->next = root_option;      // New item points to the root
-        option_item->prev = last;              // New item points to the last item
+    system_state sys_state;
+    save_state(&sys_state);
 
-        // Update the last item and root item pointers
-        last->next = option_item;              // Last item points to the new item
-        root_option->prev = option_item;      // Root item points to the new item as the previous item
-    }
+    TRACE_BEGIN("option_load", option->id);
 
-    option_item->image_object = image_global_duplicate();
-    option_item->id = strdup(key);
+    // Each option's images decode on their own loader queue, so spare workers take on other options.
+    image_loader_batch(option->index);
 
-    Image_Object *old_root = root_image;
-    root_image  = option_item->image_object;
-    root_option = option_item;
+    if (displayProgram != NULL)
+        ini_run(displayProgram);
+
+    image_loader_batch(0);
+
+    TRACE_END("option_load");
 
-    system_state sys_state;
-    save_state(&sys_state);
-    ini_read(displayTemplate, &ini_parse, NULL);
     restore_state(&sys_state);
 
-    root_image = old_root;
+    pop_vars();
+
+    option->image_list = root_list;
+    option->loaded = true;
+    option->lastUsed = ++optionClock;
+
+    root_list = old_root;
+}
+
+
+void option_unload(Option_List *option)
+{
+    if (!option->loaded)
+        return;
+
+    display_list_free(option->image_list);
+
+    option->image_list = NULL;
+    option->loaded = false;
 }
 
 
-#define MAX_RENDER_LINES 10
-SDL_Surface* render_text_wrapped(const char* text)
+void option_select(Option_List *option)
 {
-    // Split the text into lines
-    char *token;
-    char *rest = strdup(text);
-    char *lines[MAX_RENDER_LINES];
-    int numLines = 0;
+    option_load(option);
 
-    while ((token = strtok_r(rest, "||", &rest)) && numLines < MAX_RENDER_LINES)
+    if (lazyOptions)
     {
-        lines[numLines++] = strdup(token);
-    }
+        // Keep the neighbours ready so a single step never waits on a load.
+        Option_List *prev_opt = option_at(option->index - 1);
+        Option_List *next_opt = option_at(option->index + 1);
 
-    // Calculate the widest surface
-    int maxWidth = 0;
-    for (int i = 0; i < numLines; ++i)
-    {
-        int width, height;
-        TTF_SizeText(globalFont, lines[i], &width, &height);
+        option_load(prev_opt);
+        option_load(next_opt);
 
-        if (width > maxWidth)
+        for (int i = 0; i < optionCount; i++)
         {
-            maxWidth = width;
+            Option_List *current_opt = optionArray[i];
+
+            if (current_opt != option && current_opt != prev_opt && current_opt != next_opt)
+                option_unload(current_opt);
         }
     }
 
-    // Create a surface to render the text
-    SDL_Surface* renderedSurface = SDL_CreateRGBSurfaceWithFormat(0, maxWidth, numLines * TTF_FontLineSkip(globalFont), 32, SDL_PIXELFORMAT_RGBA8888);
-    if (!renderedSurface)
-    {
-        printf("Unable to create surface for rendering text! SDL Error: %s\n", SDL_GetError());
-        return NULL;
-    }
+    root_option = option;
+    root_list   = option->image_list;
+
+    // Whatever this option still waits on is decoded before any other option's images.
+    for (int i = 0; i < root_list->count; i++)
+        image_loader_prioritize(root_list->items[i].texture);
+
+    option->lastUsed = ++optionClock;
 
-    // Fill the surface with a transparent background
-    SDL_FillRect(renderedSurface, NULL, SDL_MapRGBA(renderedSurface->format, 0, 0, 0, 0));
+    option_evict();
+}
+
+
+void option_evict()
+{   // Unload the least recently used options until the textures fit the budget again.
+    // Shared textures only go once nothing uses them, so keep going until it fits or we run out.
+    if (textureBudget <= 0 || root_option == NULL)
+        return;
 
-    // Render each line of text onto the surface with alignment
-    int yOffset = 0;
-    fprintf(stderr, "render_text_wrapped:\n");
-    for (int i = 0; i < numLines; ++i)
+    while (textureBytes > textureBudget)
     {
-        fprintf(stderr, "- %s\n", lines[i]);
-        SDL_Surface* tempSurface = TTF_RenderText_Blended_Wrapped(globalFont, lines[i], (SDL_Color){255, 255, 255, 255}, maxWidth);
-        if (!tempSurface)
+        Option_List *victim = NULL;
+
+        for (int i = 0; i < optionCount; i++)
         {
-            fprintf(stderr, "Unable to render text surface! SDL_ttf Error: %s\n", TTF_GetError());
-            continue;
-        }
+            Option_List *current_opt = optionArray[i];
 
-        int xOffset = 0;
-        if (textAlignment == ALIGN_CENTER)
-        {   // Center alignment
-            xOffset = (maxWidth - tempSurface->w) / 2;
-        }
-        else if (textAlignment == ALIGN_RIGHT)
-        {   // Right alignment
-            xOffset = maxWidth - tempSurface->w;
+            if (current_opt != root_option && current_opt->loaded &&
+                (victim == NULL || current_opt->lastUsed < victim->lastUsed))
+            {
+                victim = current_opt;
+            }
         }
 
-        SDL_Rect destRect = {xOffset, yOffset, tempSurface->w, tempSurface->h};
-        SDL_BlitSurface(tempSurface, NULL, renderedSurface, &destRect);
-        SDL_FreeSurface(tempSurface);
+        if (victim == NULL)
+            break;
 
-        yOffset += TTF_FontLineSkip(globalFont);
+        option_unload(victim);
+        optionEvictions++;
     }
-
-    // Free memory
-    // free(rest);
-
-    return renderedSurface;
 }
 
 
-bool load_image(const char *imageFile)
+bool load_image(const char *imageRef)
 {
     // Load image
-    char *imageRef = sub_vars(imageFile);
-
     if (imageRef == NULL)
         return false;
 
-    if (!file_exists(imageRef))
-    {
-        fprintf(stderr, "load_image: %s: file doesn't exist.\n", imageRef);
-        return false;
-    }
+    TRACE_BEGIN("load_image", imageRef);
 
-    SDL_Surface *imageSurface = IMG_Load(imageRef);
-    free(imageRef);
+    Texture_Entry *entry = texture_cache_get(imageRef, imageSize, &globalMargins);
 
-    if (imageSurface == NULL)
+    if (entry == NULL)
     {
-        fprintf(stderr, "IMG: Couldn't load %s: %s\n", imageRef, IMG_GetError());
+        fprintf(stderr, "load_image: %s: file doesn't exist.\n", imageRef);
+        TRACE_END("load_image");
         return false;
     }
 
-    SDL_Texture *imageTexture = SDL_CreateTextureFromSurface(renderer, imageSurface);
-    SDL_FreeSurface(imageSurface);
-
-    if (imageSurface == NULL)
+    // Not an image, or an earlier decode of it failed, so let image_fallback have a go.
+    if (entry->failed)
     {
+        texture_release(entry);
+        TRACE_END("load_image");
         return false;
     }
 
+    // The layer is added now to keep the draw order, the texture may arrive once the decode has finished.
     Image_Object *image = image_create();
 
-    image->imageTexture = imageTexture;
+    image->texture        = entry;
+    image->needsLayout    = true;
+    image->layoutSize     = imageSize;
+    image->layoutPosition = imagePosition;
+    ASSIGN_RECT(image->layoutMargins, globalMargins);
 
-    calculate_texture_size(image->imageTexture, &image->imageRect, imageSize);
-    calculate_texture_rect(image->imageTexture, &image->imageRect, imagePosition);
+    image_texture(image);
 
+    TRACE_END("load_image");
     return true;
 }
 
@@ -993,7 +1915,7 @@ void font_size(int size)
 }
 
 
-bool load_font(const char *fontFile)
+bool load_font(const char *fontRef)
 {
     int scaleSize;
 
@@ -1006,43 +1928,32 @@ bool load_font(const char *fontFile)
         scaleSize = (int)(float)((screenHeight / 480.0f) * (float)fontSize);
     } 
 
-    char *fontRef = sub_vars(fontFile);
-
     if (fontRef == NULL)
         return false;
 
-    if (!file_exists(fontRef))
-    {
-        fprintf(stderr, "load_font: %s: file doesn't exist.\n", fontRef);
-        return false;
-    }
-
-    TTF_Font *oldFont = globalFont;
+    // Switching sizes or restoring a previous font is just a cache lookup.
+    TTF_Font *font = font_cache_open(fontRef, scaleSize);
 
-    globalFont = TTF_OpenFont(fontRef, scaleSize);
-    if (globalFont == NULL)
-    {   // Restore old font.
-        globalFont = oldFont;
-
-        fprintf(stderr, "TTF: Couldn't load %s: %s\n", fontRef, TTF_GetError());
+    if (font == NULL)
+    {   // Keep the old font.
         return false;
     }
 
-    if (oldFont != NULL)
-    {
-        free(globalFontName);
-        TTF_CloseFont(oldFont);
-    }
+    globalFont = font;
+
+    // fontRef may well be globalFontName itself.
+    char *fontName = strdup(fontRef);
+    free(globalFontName);
+    globalFontName = fontName;
 
-    globalFontName = fontRef;
+    font_cache_trim();
 
     return true;
 }
 
 
-bool render_text(const char *text)
+bool render_text(const char *textRef)
 {
-    char *textRef = sub_vars(text);
     if (textRef == NULL)
         return false;
 
@@ -1052,170 +1963,592 @@ bool render_text(const char *text)
         return false;
     }
 
-    SDL_Surface *imageSurface = render_text_wrapped(textRef);
-    if (imageSurface == NULL)
+    TRACE_BEGIN("render_text", textRef);
+
+    // Glyphs come from the font's atlas, so only new characters cost any rasterizing.
+    Text_Run *textRun = font_render_text(globalFont, textRef, textAlignment);
+    if (textRun == NULL)
     {
-        fprintf(stderr, "TTF: Couldn't render \"%s\" -> \"%s\": %s\n", text, textRef, IMG_GetError());
-        free(textRef);
+        fprintf(stderr, "TTF: Couldn't render \"%s\": %s\n", textRef, TTF_GetError());
+        TRACE_END("render_text");
         return false;
     }
 
-    free(textRef);
+    SDL_Rect textRect;
 
-    SDL_Texture *imageTexture = SDL_CreateTextureFromSurface(renderer, imageSurface);
-    SDL_FreeSurface(imageSurface);
+    calculate_texture_size(textRun->width, textRun->height, &textRect, SIZE_ORIGINAL, &globalMargins);
+    calculate_texture_rect(&textRect, textPosition, &globalMargins);
 
-    if (imageSurface == NULL)
+    // The shadow goes first so it's drawn underneath.
+    if (dropShadow)
     {
-        return false;
-    }
+        Image_Object *dropImage = image_create();
 
-    Image_Object *dropImage = NULL;
-    if (dropShadow)
-        dropImage = image_create();
+        dropImage->text = text_run_ref(textRun);
+        dropImage->drawColor.r = dropShadowColor.r;
+        dropImage->drawColor.g = dropShadowColor.g;
+        dropImage->drawColor.b = dropShadowColor.b;
+
+        dropImage->imageRect.x = textRect.x + dropShadowOffset.x;
+        dropImage->imageRect.y = textRect.y + dropShadowOffset.y;
+        dropImage->imageRect.w = textRect.w;
+        dropImage->imageRect.h = textRect.h;
+    }
 
     Image_Object *image = image_create();
 
-    image->imageTexture = imageTexture;
+    image->text = textRun;
     image->drawColor.r = textColor.r;
     image->drawColor.g = textColor.g;
     image->drawColor.b = textColor.b;
 
-    calculate_texture_size(image->imageTexture, &image->imageRect, SIZE_ORIGINAL);
-    calculate_texture_rect(image->imageTexture, &image->imageRect, textPosition);
+    ASSIGN_RECT(image->imageRect, textRect);
 
-    if (dropShadow)
+    TRACE_END("render_text");
+    return true;
+}
+
+
+Display_List *display_list_create()
+{
+    return (Display_List *)ez_malloc(sizeof(Display_List));
+}
+
+
+Display_List *display_list_clone(const Display_List *list)
+{   // Copies share their textures and text, so only the references need bumping.
+    Display_List *result = display_list_create();
+
+    if (list->count == 0)
+        return result;
+
+    result->items    = (Image_Object *)ez_malloc(list->capacity * sizeof(Image_Object));
+    result->count    = list->count;
+    result->capacity = list->capacity;
+
+    memcpy(result->items, list->items, list->count * sizeof(Image_Object));
+
+    result->composite = NULL;
+
+    for (int i = 0; i < result->count; i++)
     {
-        dropImage->imageTexture = imageTexture;
-        dropImage->drawColor.r = dropShadowColor.r;
-        dropImage->drawColor.g = dropShadowColor.g;
-        dropImage->drawColor.b = dropShadowColor.b;
+        texture_ref(result->items[i].texture);
+        text_run_ref(result->items[i].text);
+    }
+
+    return result;
+}
+
+
+void display_list_clear(Display_List *list)
+{   // Drops every layer but keeps the storage for the next scene.
+    for (int i = 0; i < list->count; i++)
+    {
+        texture_release(list->items[i].texture);
+        text_run_release(list->items[i].text);
+    }
+
+    list->count = 0;
+
+    display_list_invalidate(list);
+}
+
+
+void display_list_free(Display_List *list)
+{
+    if (list == NULL)
+        return;
+
+    display_list_clear(list);
+
+    free(list->items);
+    free(list);
+}
+
+
+Image_Object *display_list_append(Display_List *list)
+{   // The returned pointer is only valid until the next append.
+    display_list_invalidate(list);
+
+    if (list->count == list->capacity)
+    {
+        list->capacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+        list->items = (Image_Object *)realloc(list->items, list->capacity * sizeof(Image_Object));
+
+        if (list->items == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory. :(\n");
+            exit(255);
+        }
+    }
+
+    Image_Object *image = &list->items[list->count++];
+
+    memset(image, '\0', sizeof(Image_Object));
+
+    return image;
+}
+
+
+void display_list_invalidate(Display_List *list)
+{
+    if (list->composite != NULL)
+    {
+        SDL_DestroyTexture(list->composite);
+        list->composite = NULL;
+
+        texture_memory_add(-(Sint64)screenWidth * screenHeight * 4);
+    }
+}
+
 
-        dropImage->imageRect.x = image->imageRect.x + dropShadowOffset.x;
-        dropImage->imageRect.y = image->imageRect.y + dropShadowOffset.y;
-        dropImage->imageRect.w = image->imageRect.w;
-        dropImage->imageRect.h = image->imageRect.h;
+void display_list_invalidate_all()
+{   // Lists notice the new generation the next time they are drawn.
+    compositeGeneration++;
+
+    display_damage_all();
+}
+
+
+static bool display_list_ready(Display_List *list)
+{   // A scene is only static once every image has finished loading.
+    for (int i = 0; i < list->count; i++)
+    {
+        Texture_Entry *entry = list->items[i].texture;
+
+        if (entry != NULL && !texture_ready(entry) && !entry->failed)
+            return false;
     }
 
     return true;
 }
 
 
-Image_Object *image_global_duplicate()
+static void display_list_composite(Display_List *list)
 {
-    Image_Object *current = global_image;
-    Image_Object *result  = NULL;
-    Image_Object *last    = NULL;
+    SDL_Texture *composite = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_TARGET, screenWidth, screenHeight);
+
+    if (composite == NULL)
+        return;
 
-    while (current != NULL)
+    if (SDL_SetRenderTarget(renderer, composite) != 0)
     {
-        Image_Object *object = (Image_Object *)ez_malloc(sizeof(Image_Object));
+        SDL_DestroyTexture(composite);
+        return;
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+
+    for (int i = 0; i < list->count; i++)
+        image_draw(&list->items[i]);
+
+    SDL_SetRenderTarget(renderer, NULL);
+
+    list->composite = composite;
+    list->compositeGeneration = compositeGeneration;
+    compositesBuilt++;
 
-        memcpy(object, current, sizeof(Image_Object));
+    texture_memory_add((Sint64)screenWidth * screenHeight * 4);
+}
+
+
+static bool image_bounds(Image_Object *image, SDL_Rect *rect)
+{   // Where the layer lands on screen, false while it has nothing to draw.
+    if (image->text == NULL && !image_layout(image))
+        return false;
+
+    *rect = image->imageRect;
+    return true;
+}
 
-        object->next = NULL;
-        object->duplicate = true;
 
-        if (last != NULL)
-            last->next = object;
+static void damage_add(SDL_Rect *damage, const SDL_Rect *rect)
+{
+    if (SDL_RectEmpty(rect))
+        return;
 
-        if (result == NULL)
-            result = object;
+    if (SDL_RectEmpty(damage))
+        *damage = *rect;
+    else
+        SDL_UnionRect(damage, rect, damage);
+}
 
-        last = current;
-        current = current->next;
+
+static bool damage_item_equal(const Damage_Item *a, const Damage_Item *b)
+{
+    return a->texture == b->texture && a->text == b->text && a->ready == b->ready &&
+        SDL_RectEquals(&a->rect, &b->rect) &&
+        a->color.r == b->color.r && a->color.g == b->color.g && a->color.b == b->color.b;
+}
+
+
+static void damage_item_release(Damage_Item *item)
+{
+    texture_release(item->texture);
+    text_run_release(item->text);
+
+    memset(item, '\0', sizeof(Damage_Item));
+}
+
+
+bool display_list_damage(Display_List *list, SDL_Rect *damage)
+{   // Compares each layer with the one presented at the same depth last frame, and adds both
+    // rects of any that changed to damage. Switching between options that share a background
+    // only damages what differs.
+    if (list->count > presentedCapacity)
+    {
+        presentedItems = (Damage_Item*)realloc(presentedItems, list->count * sizeof(Damage_Item));
+
+        if (presentedItems == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory. :(\n");
+            exit(255);
+        }
+
+        memset(presentedItems + presentedCapacity, '\0', (list->count - presentedCapacity) * sizeof(Damage_Item));
+        presentedCapacity = list->count;
     }
 
-    return result;
+    int count = SDL_max(list->count, presentedCount);
+
+    for (int i = 0; i < count; i++)
+    {
+        Damage_Item current;
+        memset(&current, '\0', sizeof(current));
+
+        if (i < list->count)
+        {
+            Image_Object *image = &list->items[i];
+
+            current.texture = image->texture;
+            current.text    = image->text;
+            current.ready   = image_bounds(image, &current.rect);
+            current.color   = image->drawColor;
+
+            if (!current.ready)
+                memset(&current.rect, '\0', sizeof(SDL_Rect));
+        }
+
+        Damage_Item *presented = &presentedItems[i];
+
+        if (i < presentedCount && damage_item_equal(presented, &current))
+            continue;
+
+        damage_add(damage, &presented->rect);
+        damage_add(damage, &current.rect);
+
+        damage_item_release(presented);
+
+        if (i < list->count)
+        {
+            *presented = current;
+            texture_ref(presented->texture);
+            text_run_ref(presented->text);
+        }
+    }
+
+    presentedCount = list->count;
+
+    if (damageAll)
+    {
+        SDL_Rect screen = {0, 0, screenWidth, screenHeight};
+        *damage = screen;
+        damageAll = false;
+    }
+
+    return !SDL_RectEmpty(damage);
+}
+
+
+void display_damage_all()
+{   // For when the screen itself was lost, the next frame is drawn in full.
+    damageAll = true;
+}
+
+
+void display_damage_free()
+{
+    for (int i = 0; i < presentedCapacity; i++)
+        damage_item_release(&presentedItems[i]);
+
+    free(presentedItems);
+
+    presentedItems = NULL;
+    presentedCount = presentedCapacity = 0;
+}
+
+
+void display_list_draw(Display_List *list, const SDL_Rect *clip)
+{   // clip limits drawing to the damaged part of the screen, NULL draws all of it.
+    if (list->composite != NULL && list->compositeGeneration != compositeGeneration)
+        display_list_invalidate(list);
+
+    if (clip != NULL)
+        SDL_RenderSetClipRect(renderer, clip);
+
+    if (cpuCompositor)
+    {   // The window surface keeps the last frame, it only needs the damage composed again.
+        SDL_Rect screen = {0, 0, screenWidth, screenHeight};
+
+        compose_list(list, (clip != NULL) ? clip : &screen);
+        return;
+    }
+
+    if (list->composite == NULL && compositeLayers && list->count > 1 &&
+        SDL_RenderTargetSupported(renderer) && display_list_ready(list))
+    {
+        display_list_composite(list);
+    }
+
+    if (clip != NULL)
+    {   // Nothing else clears what a removed layer left behind.
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderFillRect(renderer, clip);
+    }
+
+    if (list->composite != NULL)
+    {
+        SDL_RenderCopy(renderer, list->composite, NULL, NULL);
+        return;
+    }
+
+    SDL_Rect bounds;
+
+    for (int i = 0; i < list->count; i++)
+    {
+        Image_Object *image = &list->items[i];
+
+        if (clip != NULL && (!image_bounds(image, &bounds) || !SDL_HasIntersection(&bounds, clip)))
+        {
+            layersCulled++;
+            continue;
+        }
+
+        image_draw(image);
+    }
 }
 
 
 Image_Object *image_create()
 {
-    Image_Object *image = (Image_Object *)ez_malloc(sizeof(Image_Object));
+    Image_Object *image = display_list_append(root_list);
 
     image->drawColor.r = 255;
     image->drawColor.g = 255;
     image->drawColor.b = 255;
     image->drawColor.a = 255;
 
-    image->duplicate = false;
+    return image;
+}
+
+bool image_layout(Image_Object *image)
+{   // Returns true once the image is ready to draw, laying it out the first time.
+    if (!texture_ready(image->texture))
+        return false;
+
+    if (image->needsLayout)
+    {
+        calculate_texture_size(image->texture->width, image->texture->height, &image->imageRect, image->layoutSize, &image->layoutMargins);
+        calculate_texture_rect(&image->imageRect, image->layoutPosition, &image->layoutMargins);
+        image->needsLayout = false;
+    }
+
+    return true;
+}
+
+
+SDL_Texture *image_texture(Image_Object *image)
+{
+    if (!image_layout(image))
+        return NULL;
+
+    return image->texture->texture;
+}
+
 
-    if (global_image == NULL && root_option == NULL)
+static void text_run_copy(Image_Object *image, int first, int last)
+{   // One copy per glyph, for SDL older than 2.0.18 or a renderer without geometry support.
+    Text_Run *run = image->text;
+    SDL_Texture *page = run->quads[first].page->texture;
+
+    SDL_SetTextureColorMod(page, image->drawColor.r, image->drawColor.g, image->drawColor.b);
+
+    for (int i = first; i < last; i++)
     {
-        global_image = image;
+        Glyph_Quad *quad = &run->quads[i];
+        SDL_Rect dst = {
+            image->imageRect.x + quad->dst.x, image->imageRect.y + quad->dst.y,
+            quad->dst.w, quad->dst.h};
+
+        SDL_RenderCopy(renderer, page, &quad->src, &dst);
     }
+}
+
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+static SDL_Vertex *textVertices = NULL;
+static int        *textIndices  = NULL;
+static int         textCapacity = 0;       // in quads.
+
 
-    if (root_image == NULL)
+static bool text_run_geometry(Image_Object *image, int first, int last)
+{   // The quads from first to last share a page, so they go out as a single draw call.
+    // The colour is in the vertices, which does the same as the colour mod.
+    Text_Run *run = image->text;
+    Texture_Entry *page = run->quads[first].page;
+    int count = last - first;
+
+    if (count > textCapacity)
     {
-        root_image = image;
+        textCapacity = SDL_max(count, textCapacity * 2);
+        textVertices = (SDL_Vertex*)realloc(textVertices, textCapacity * 4 * sizeof(SDL_Vertex));
+        textIndices  = (int*)realloc(textIndices, textCapacity * 6 * sizeof(int));
+
+        if (textVertices == NULL || textIndices == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory. :(\n");
+            exit(255);
+        }
     }
-    else
+
+    float scaleX = 1.0f / page->width;
+    float scaleY = 1.0f / page->height;
+
+    for (int i = 0; i < count; i++)
     {
-        Image_Object *current = root_image;
+        Glyph_Quad *quad = &run->quads[first + i];
+        SDL_Vertex *vertex = &textVertices[i * 4];
+        int *index = &textIndices[i * 6];
 
-        while (current->next != NULL)
-            current = current->next;
+        float left   = (float)(image->imageRect.x + quad->dst.x);
+        float top    = (float)(image->imageRect.y + quad->dst.y);
+        float right  = left + quad->dst.w;
+        float bottom = top + quad->dst.h;
 
-        current->next = image;
+        float u0 = quad->src.x * scaleX;
+        float v0 = quad->src.y * scaleY;
+        float u1 = (quad->src.x + quad->src.w) * scaleX;
+        float v1 = (quad->src.y + quad->src.h) * scaleY;
+
+        vertex[0] = (SDL_Vertex){{left,  top},    image->drawColor, {u0, v0}};
+        vertex[1] = (SDL_Vertex){{right, top},    image->drawColor, {u1, v0}};
+        vertex[2] = (SDL_Vertex){{right, bottom}, image->drawColor, {u1, v1}};
+        vertex[3] = (SDL_Vertex){{left,  bottom}, image->drawColor, {u0, v1}};
+
+        index[0] = i * 4;
+        index[1] = i * 4 + 1;
+        index[2] = i * 4 + 2;
+        index[3] = i * 4;
+        index[4] = i * 4 + 2;
+        index[5] = i * 4 + 3;
     }
 
-    return image;
-}
+    // The page may still carry a colour mod from an older copy, that would tint the vertex colour again.
+    SDL_SetTextureColorMod(page->texture, 255, 255, 255);
 
-void image_init()
-{
-    // Create the root object. It does nothing. :D
-    image_create();
+    return SDL_RenderGeometry(renderer, page->texture, textVertices, count * 4, textIndices, count * 6) == 0;
 }
+#endif
 
-void image_quit()
-{
-    Image_Object *current_img = global_image;
-    Image_Object *next_img = NULL;
 
-    while (current_img != NULL)
+static void text_run_draw(Image_Object *image)
+{   // Glyphs are grouped by atlas page, most strings only ever touch one.
+    Text_Run *run = image->text;
+    int first = 0;
+
+    while (first < run->count)
     {
-        next_img = current_img->next;
+        int last = first + 1;
 
-        if (!current_img->duplicate && current_img->imageTexture != NULL)
-            SDL_DestroyTexture(current_img->imageTexture);
+        while (last < run->count && run->quads[last].page == run->quads[first].page)
+            last++;
 
-        free(current_img);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        if (!text_run_geometry(image, first, last))
+#endif
+            text_run_copy(image, first, last);
 
-        current_img = next_img;
+        first = last;
     }
+}
 
-    if (root_option != NULL)
+
+void image_draw(Image_Object *image)
+{
+    if (image->text != NULL)
     {
-        Option_List *current_opt = root_option;
-        Option_List *next_opt;
+        text_run_draw(image);
+        return;
+    }
 
-        // Break the double linked list.
-        current_opt->prev->next = NULL;
+    SDL_Texture *imageTexture = image_texture(image);
 
-        while (current_opt)
-        {
-            next_opt = current_opt->next;
+    if (imageTexture != NULL)
+    {
+        SDL_SetTextureColorMod(
+            imageTexture,
+            image->drawColor.r, image->drawColor.g, image->drawColor.b);
 
-            current_img = current_opt->image_object;
+        SDL_RenderCopy(renderer, imageTexture, NULL, &image->imageRect);
+    }
+}
 
-            while (current_img != NULL)
-            {
-                next_img = current_img->next;
 
-                if (!current_img->duplicate && current_img->imageTexture != NULL)
-                    SDL_DestroyTexture(current_img->imageTexture);
+void image_init()
+{
+    image_loader_init();
 
-                free(current_img);
+    // Everything loaded before the options goes into the global list.
+    global_list = display_list_create();
+    root_list = global_list;
+}
 
-                current_img = next_img;
-            }
 
-            free(current_opt->id);
-            free(current_opt);
+void image_quit()
+{
+    image_loader_quit();
 
-            current_opt = next_opt;
-        }
+    display_list_free(global_list);
+    global_list = NULL;
+    root_list = NULL;
+
+    for (int i = 0; i < optionCount; i++)
+    {
+        Option_List *current_opt = optionArray[i];
+
+        option_unload(current_opt);
+
+        free(current_opt->id);
+        free(current_opt->vars);
+        free(current_opt);
     }
+
+    free(optionArray);
+    free(optionHash);
+
+    optionArray = NULL;
+    optionHash = NULL;
+    optionCount = optionCapacity = optionHashSize = 0;
+    root_option = NULL;
+
+    ini_program_free(displayProgram);
+    displayProgram = NULL;
+
+    display_damage_free();
+    compose_quit();
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    free(textVertices);
+    free(textIndices);
+
+    textVertices = NULL;
+    textIndices  = NULL;
+    textCapacity = 0;
+#endif
+
+    // Atlas pages are textures too, so they have to go before the renderer does.
+    font_cache_quit();
+    texture_cache_quit();
 }
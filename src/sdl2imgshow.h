@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
@@ -14,6 +15,14 @@
 #define UNUSED(x) (void)(x)
 
 
+// Begin/end spans for --trace, a single branch when tracing is off.
+#define TRACE_BEGIN(name, arg) \
+    do { if (traceEnabled) trace_event('B', name, arg); } while (0)
+
+#define TRACE_END(name) \
+    do { if (traceEnabled) trace_event('E', name, NULL); } while (0)
+
+
 #define ASSIGN_RECT(to_var, from_var) \
     { \
         to_var.x = from_var.x; \
@@ -38,6 +47,13 @@
 
 
 // Types
+enum
+{
+    DAEMON_NONE,
+    DAEMON_PRESENT,
+    DAEMON_QUIT,
+};
+
 enum
 {
     POS_TOPLEFT,
@@ -71,32 +87,223 @@ enum
 };
 
 
+// A whole file mapped read-only, SDL reads assets from it through SDL_RWFromConstMem.
+typedef struct _File_Map
+{
+    int     refs;
+    void   *data;
+    size_t  size;
+} File_Map;
+
+
+typedef struct _Texture_Entry
+{
+    struct _Texture_Entry *next;
+    struct _Image_Job     *job;     // set while the image is still being decoded.
+    char        *path;              // NULL for textures that aren't loaded from a file.
+    Uint32       hash;
+    dev_t        dev;
+    ino_t        ino;
+    time_t       mtime;
+    int          layoutSize;        // image_stretch mode and space it was resampled for.
+    int          boxWidth;
+    int          boxHeight;
+    int          refs;
+    SDL_Texture *texture;
+    int          width;             // size of the source image, the texture itself may be smaller.
+    int          height;
+    Sint64       bytes;             // what the texture costs, counted in textureBytes.
+    bool         failed;
+    bool         negative;          // failed before it was queued, the cache holds a reference to it.
+
+    // With the CPU compositor the pixels stay in an ARGB8888 surface and there is no texture.
+    SDL_Surface *surface;
+    bool         opaque;            // every alpha is 255, rows can be copied.
+    bool         mask;              // white with alpha, like glyph pages, only the alpha matters.
+} Texture_Entry;
+
+
+typedef struct _Image_Job
+{
+    struct _Image_Job *next;
+    struct _Image_Job *prev;
+    struct _Loader_Queue *queue;    // the queue it is waiting in, NULL once a worker has it.
+    char          *path;
+    File_Map      *map;             // mapped when the job is queued, released once it's decoded.
+    Texture_Entry *entry;           // NULL if the texture was released before the decode finished.
+    int            layoutSize;
+    SDL_Rect       layoutMargins;
+    SDL_Surface   *surface;
+    int            sourceWidth;
+    int            sourceHeight;
+    bool           opaque;
+} Image_Job;
+
+
+typedef struct _Glyph_Quad
+{
+    Texture_Entry *page;
+    SDL_Rect       src;
+    SDL_Rect       dst;             // relative to the top left of the text.
+} Glyph_Quad;
+
+
+typedef struct _Text_Run
+{
+    int         refs;
+    int         width;
+    int         height;
+    int         count;
+    Glyph_Quad *quads;
+} Text_Run;
+
+
 typedef struct _Image_Object
 {
-    struct _Image_Object *next;
-    SDL_Texture *imageTexture;
+    Texture_Entry *texture;
+    Text_Run      *text;
     SDL_Rect     imageRect;
     SDL_Color    drawColor;
-    bool         duplicate;
+
+    // Layout is deferred until the texture size is known.
+    bool         needsLayout;
+    int          layoutSize;
+    int          layoutPosition;
+    SDL_Rect     layoutMargins;
 } Image_Object;
 
 
+typedef struct _Display_List
+{
+    Image_Object *items;
+    int           count;
+    int           capacity;
+
+    // Every layer flattened into one texture, rebuilt when the scene changes.
+    SDL_Texture  *composite;
+    int           compositeGeneration;
+} Display_List;
+
+
+// One layer as it was last presented, see display_list_damage().
+typedef struct _Damage_Item
+{
+    Texture_Entry *texture;         // referenced, so the pointer can't be reused by another texture.
+    Text_Run      *text;
+    bool           ready;
+    SDL_Rect       rect;
+    SDL_Color      color;
+} Damage_Item;
+
+
 typedef struct _Option_List
 {
-    struct _Option_List *next;
-    struct _Option_List *prev;
+    int index;          // position in the option array, see option_at().
     char *id;
-    Image_Object *image_object;
+    char *vars;     // the raw option line, replayed every time the option is loaded.
+    bool loaded;
+    Uint32 lastUsed;    // option clock when last loaded or selected, the lowest is evicted first.
+    Display_List *image_list;
 } Option_List;
 
 
+typedef struct _Template_Segment
+{
+    const char *text;               // literal text, or the variable name as written.
+    size_t      length;
+    const struct _var_key *key;     // NULL for literal text.
+} Template_Segment;
+
+
+typedef struct _Template
+{
+    char             *source;
+    int               count;
+    Template_Segment *segments;
+} Template;
+
+
+// One opcode per INI key, see ini_exec().
+enum
+{
+    INI_UNKNOWN,
+    INI_IMAGE,
+    INI_IMAGE_FALLBACK,
+    INI_IMAGE_POSITION,
+    INI_IMAGE_STRETCH,
+    INI_TEXT_POSITION,
+    INI_TEXT_ALIGN,
+    INI_SCREEN_MARGIN,
+    INI_FONT,
+    INI_FONT_FALLBACK,
+    INI_FONT_SIZE,
+    INI_TEXT,
+    INI_TEXT_COLOR,
+    INI_SHADOW_COLOR,
+    INI_SHADOW_OFFSET,
+    INI_SHADOW,
+    INI_QUIET,
+    INI_QUIT,
+    INI_WAIT_QUIT,
+    INI_KEYPRESS_QUIT,
+    INI_SET,
+    INI_SET_STRICT,
+    INI_DISABLE_FONT_SCALE,
+    INI_LAZY_OPTIONS,
+    INI_FONT_CACHE_SIZE,
+    INI_STATS,
+    INI_WATCH_PROCESS,
+    INI_WATCH_MATCH,
+    INI_COMPOSITE_LAYERS,
+    INI_TEXTURE_BUDGET,
+    INI_PROGRESS,
+    INI_PROGRESS_POSITION,
+    INI_PROGRESS_SIZE,
+    INI_PROGRESS_COLOR,
+    INI_PROGRESS_BACKGROUND,
+    INI_PROGRESS_FILE,
+    INI_PROGRESS_FD,
+};
+
+
+typedef struct _Ini_Instr
+{
+    int       op;
+    char     *key;
+    char     *value;
+    Template *tmpl;         // values that take variable substitution.
+    char     *name;         // variable name for set and set_strict.
+    int       number;       // positions, stretch modes, sizes and bools.
+    int       parsed;       // how many of fields[] the value had.
+    int       fields[4];    // margins, colours and offsets.
+} Ini_Instr;
+
+
+typedef struct _Ini_Program
+{
+    Ini_Instr *instrs;
+    int        count;
+    int        capacity;
+} Ini_Program;
+
+
 typedef void (*ini_callback)(void *state, const char *key, const char *value);
 
 // Globals
-extern Image_Object *global_image;
-extern Image_Object *root_image;
+extern Display_List *global_list;
+extern Display_List *root_list;
 extern Option_List *root_option;
 
+extern SDL_Renderer *renderer;
+extern bool traceEnabled;
+extern Uint32 imageLoaderEvent;
+extern Uint32 processWatchEvent;
+extern Uint32 daemonEvent;
+extern Uint32 progressEvent;
+extern SDL_Color progressColor;
+extern SDL_Color progressBackground;
+extern bool processWatchExact;
+
 extern int screenWidth;
 extern int screenHeight;
 extern int imageSize;
@@ -106,6 +313,14 @@ extern int textAlignment;
 extern int fontSize;
 extern bool dropShadow;
 extern bool wantQuit;
+extern bool lazyOptions;
+extern bool showStats;
+extern bool compositeLayers;
+extern bool cpuCompositor;
+extern int fontCacheSize;
+extern Sint64 textureBytes;
+extern Sint64 textureBudget;
+extern const char *bakeCacheDir;
 
 extern TTF_Font* globalFont;
 extern SDL_Rect  globalMargins;
@@ -117,24 +332,118 @@ extern SDL_Point dropShadowOffset;
 void *ez_malloc(size_t size);
 
 Image_Object *image_create();
-Image_Object *image_copy_stack();
-Image_Object *image_global_duplicate();
+
+Display_List *display_list_create();
+Display_List *display_list_clone(const Display_List *list);
+void display_list_clear(Display_List *list);
+void display_list_free(Display_List *list);
+Image_Object *display_list_append(Display_List *list);
+void display_list_invalidate(Display_List *list);
+void display_list_invalidate_all();
+bool display_list_damage(Display_List *list, SDL_Rect *damage);
+void display_damage_all();
+void display_damage_free();
+void display_list_draw(Display_List *list, const SDL_Rect *clip);
 
 void image_init();
 void image_quit();
+bool image_layout(Image_Object *image);
+SDL_Texture *image_texture(Image_Object *image);
+void image_draw(Image_Object *image);
+
+void image_loader_init();
+void image_loader_quit();
+bool image_loader_queue(Texture_Entry *entry, const SDL_Rect *margins);
+void image_loader_cancel(Texture_Entry *entry);
+void image_loader_batch(int batch);
+void image_loader_prioritize(Texture_Entry *entry);
+int image_loader_pump();
+bool image_loader_busy();
+void image_loader_stats();
+SDL_Surface *image_resample(SDL_Surface *surface, int width, int height);
+void image_loader_flush();
+
+Texture_Entry *texture_cache_get(const char *path, int layoutSize, const SDL_Rect *margins);
+Texture_Entry *texture_create(SDL_Texture *texture);
+Texture_Entry *texture_create_surface(SDL_Surface *surface);
+Texture_Entry *texture_ref(Texture_Entry *entry);
+bool texture_ready(const Texture_Entry *entry);
+void texture_account(Texture_Entry *entry, SDL_Texture *texture);
+void texture_account_surface(Texture_Entry *entry);
+void texture_memory_add(Sint64 bytes);
+void texture_memory_stats();
+void texture_release(Texture_Entry *entry);
+void texture_cache_quit();
+
+void daemon_args(int *argc, char *argv[]);
+bool daemon_start();
+int daemon_command(SDL_Event *event);
+Display_List *daemon_scene();
+void daemon_quit();
+
+bool compose_init(SDL_Surface *target);
+bool compose_opaque(const SDL_Surface *surface);
+void compose_list(Display_List *list, const SDL_Rect *clip);
+void compose_stats();
+void compose_quit();
+
+void progress_set_value(const char *value);
+void progress_set_source(const char *path, int fd);
+void progress_set_layout(int position, int width, int height);
+bool progress_start();
+bool progress_event(SDL_Event *event);
+void progress_damage(SDL_Rect *damage);
+void progress_draw();
+void progress_quit();
+
+void trace_args(int *argc, char *argv[]);
+void trace_event(char phase, const char *name, const char *arg);
+void trace_close();
+
+bool bake_restore(const Ini_Program *program);
+void bake_capture();
+
+void process_watch_add(const char *name);
+bool process_watch_start();
+void process_watch_quit();
+
+TTF_Font *font_cache_open(const char *path, int size);
+void font_cache_trim();
+void font_cache_quit();
+void font_cache_stats();
+Text_Run *font_render_text(TTF_Font *font, const char *text, int alignment);
+Text_Run *text_run_ref(Text_Run *run);
+void text_run_release(Text_Run *run);
 
 int sdl_do_init();
 void sdl_do_quit();
 
 void var_set_parse(const char *text, bool var_sub);
 void ini_parse(void *state, const char *key, const char *value);
+void ini_compile_line(Ini_Instr *instr, const char *key, const char *value);
+void ini_free_line(Ini_Instr *instr);
+void ini_exec(const Ini_Instr *instr);
+Ini_Program *ini_compile(const char *filename);
+void ini_run(const Ini_Program *program);
+void ini_run_settings(const Ini_Program *program);
+bool ini_op_draws(int op);
+void ini_program_free(Ini_Program *program);
 void option_parse(void *state, const char *key, const char *value);
 int ini_read(const char *filename, ini_callback callback, void *state);
+void ini_read_buffer(char *data, size_t size, ini_callback callback, void *state);
+
+void option_load(Option_List *option);
+void option_unload(Option_List *option);
+void option_select(Option_List *option);
+Option_List *option_at(int index);
+Option_List *option_find(const char *id);
+Option_List *option_letter(Option_List *option, int direction);
+void option_evict();
 
-bool load_font(const char *fontFile);
+bool load_font(const char *fontRef);
 void font_size(int fontSize);
-bool load_image(const char *imageFile);
-bool render_text(const char *text);
+bool load_image(const char *imageRef);
+bool render_text(const char *textRef);
 
 void *ez_malloc(size_t size);
 char *ez_strcatn(char *str1, const char *str2, size_t str2_len);
@@ -145,13 +454,18 @@ int get_text_align(const char *text_align);
 
 void init_vars();
 void quit_vars();
+void push_vars();
+void pop_vars();
 void set_var(const char *name, const char *value);
 const char *get_var(const char *name);
 
 char *sub_vars(const char *input);
+Template *template_compile(const char *input);
+char *template_eval(const Template *tmpl);
+void template_free(Template *tmpl);
 
-void calculate_texture_rect(SDL_Texture *imageTexture, SDL_Rect *textureRect, int position);
-void calculate_texture_size(SDL_Texture *imageTexture, SDL_Rect *textureRect, int size);
+void calculate_texture_rect(SDL_Rect *textureRect, int position, const SDL_Rect *margins);
+void calculate_texture_size(int originalWidth, int originalHeight, SDL_Rect *textureRect, int size, const SDL_Rect *margins);
 
 int strncasecmp(const char *s1, const char *s2, size_t n);
 int strcasecmp(const char *s1, const char *s2);
@@ -161,5 +475,10 @@ bool strcaseendswith(const char *str, const char *suffix);
 bool strendswith(const char *str, const char *suffix);
 
 bool file_exists(const char *filename);
+bool file_stat(const char *filename, struct stat *info);
+File_Map *file_map(const char *filename, bool populate);
+File_Map *file_map_ref(File_Map *map);
+void file_map_release(File_Map *map);
+void asset_io_stats();
 
 #endif /* __SDL2IMGSHOW_H__ */
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#define TEXTURE_CACHE_BUCKETS 256
+
+static Texture_Entry *textureCache[TEXTURE_CACHE_BUCKETS];
+
+// Everything the renderer holds for us: images, glyph atlases and composites.
+Sint64 textureBytes  = 0;
+Sint64 textureBudget = 0;       // 0 for no limit.
+
+static Sint64 texturePeakBytes = 0;
+
+static int textureCacheHits   = 0;
+static int textureCacheMisses = 0;
+
+
+static Uint32 texture_hash(const char *path)
+{   // FNV-1a
+    Uint32 hash = 2166136261u;
+
+    while (*path)
+    {
+        hash ^= (Uint8)*path++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+static void texture_unlink(Texture_Entry *entry)
+{
+    Texture_Entry **current = &textureCache[entry->hash % TEXTURE_CACHE_BUCKETS];
+
+    while (*current != NULL)
+    {
+        if (*current == entry)
+        {
+            *current = entry->next;
+            break;
+        }
+
+        current = &(*current)->next;
+    }
+
+    entry->next = NULL;
+}
+
+
+static void texture_free(Texture_Entry *entry)
+{
+    if (entry->path != NULL)
+        texture_unlink(entry);
+
+    if (entry->job != NULL)
+        image_loader_cancel(entry);
+
+    if (entry->texture != NULL)
+        SDL_DestroyTexture(entry->texture);
+
+    if (entry->surface != NULL)
+        SDL_FreeSurface(entry->surface);
+
+    texture_memory_add(-entry->bytes);
+
+    free(entry->path);
+    free(entry);
+}
+
+
+Texture_Entry *texture_cache_get(const char *path, int layoutSize, const SDL_Rect *margins)
+{   // Returns a referenced entry for the file at `path`, queueing the decode if it's new.
+    // Images are resampled to the space they are laid out in, so that is part of the key.
+    struct stat info;
+
+    if (!file_stat(path, &info))
+        return NULL;
+
+    int boxWidth  = 0;
+    int boxHeight = 0;
+
+    if (layoutSize != SIZE_ORIGINAL)
+    {
+        boxWidth  = screenWidth - margins->x - margins->w;
+        boxHeight = screenHeight - margins->y - margins->h;
+    }
+
+    Uint32 hash = texture_hash(path);
+    Texture_Entry *entry = textureCache[hash % TEXTURE_CACHE_BUCKETS];
+
+    while (entry != NULL)
+    {
+        if (entry->hash == hash &&
+            entry->dev == info.st_dev &&
+            entry->ino == info.st_ino &&
+            entry->mtime == info.st_mtime &&
+            entry->layoutSize == layoutSize &&
+            entry->boxWidth == boxWidth &&
+            entry->boxHeight == boxHeight &&
+            strcmp(entry->path, path) == 0)
+        {
+            textureCacheHits++;
+            entry->refs++;
+            return entry;
+        }
+
+        entry = entry->next;
+    }
+
+    textureCacheMisses++;
+
+    entry = (Texture_Entry*)ez_malloc(sizeof(Texture_Entry));
+
+    entry->path  = strdup(path);
+    entry->hash  = hash;
+    entry->dev   = info.st_dev;
+    entry->ino   = info.st_ino;
+    entry->mtime = info.st_mtime;
+    entry->refs  = 1;
+
+    entry->layoutSize = layoutSize;
+    entry->boxWidth   = boxWidth;
+    entry->boxHeight  = boxHeight;
+
+    entry->next = textureCache[hash % TEXTURE_CACHE_BUCKETS];
+    textureCache[hash % TEXTURE_CACHE_BUCKETS] = entry;
+
+    // A file that isn't an image stays cached as failed, so it's only checked once. The
+    // cache keeps a reference of its own on it until texture_cache_quit().
+    if (!image_loader_queue(entry, margins))
+    {
+        entry->failed = true;
+        entry->negative = true;
+        entry->refs++;
+    }
+
+    return entry;
+}
+
+
+Texture_Entry *texture_create(SDL_Texture *texture)
+{   // Wraps a texture that isn't backed by a file, like rendered text.
+    Texture_Entry *entry = (Texture_Entry*)ez_malloc(sizeof(Texture_Entry));
+
+    entry->refs    = 1;
+    entry->texture = texture;
+
+    SDL_QueryTexture(texture, NULL, NULL, &entry->width, &entry->height);
+    texture_account(entry, texture);
+
+    return entry;
+}
+
+
+Texture_Entry *texture_create_surface(SDL_Surface *surface)
+{   // Same, for the CPU compositor, the entry owns the surface.
+    Texture_Entry *entry = (Texture_Entry*)ez_malloc(sizeof(Texture_Entry));
+
+    entry->refs    = 1;
+    entry->surface = surface;
+    entry->width   = surface->w;
+    entry->height  = surface->h;
+
+    texture_account_surface(entry);
+
+    return entry;
+}
+
+
+bool texture_ready(const Texture_Entry *entry)
+{
+    return entry != NULL && (entry->texture != NULL || entry->surface != NULL);
+}
+
+
+void texture_memory_add(Sint64 bytes)
+{
+    textureBytes += bytes;
+
+    if (textureBytes > texturePeakBytes)
+        texturePeakBytes = textureBytes;
+}
+
+
+void texture_account(Texture_Entry *entry, SDL_Texture *texture)
+{   // Charge the entry for its texture, it is given back when the entry is freed.
+    Uint32 format;
+    int width, height;
+
+    if (SDL_QueryTexture(texture, &format, NULL, &width, &height) != 0)
+        return;
+
+    entry->bytes = (Sint64)width * height * SDL_BYTESPERPIXEL(format);
+    texture_memory_add(entry->bytes);
+}
+
+
+void texture_account_surface(Texture_Entry *entry)
+{
+    entry->bytes = (Sint64)entry->surface->h * entry->surface->pitch;
+    texture_memory_add(entry->bytes);
+}
+
+
+void texture_memory_stats()
+{
+    fprintf(stderr, "texture_cache: %d hits, %d misses\n", textureCacheHits, textureCacheMisses);
+    fprintf(stderr, "texture_memory: %.1f MiB resident, %.1f MiB peak, budget %.1f MiB\n",
+        textureBytes / 1048576.0, texturePeakBytes / 1048576.0, textureBudget / 1048576.0);
+}
+
+
+Texture_Entry *texture_ref(Texture_Entry *entry)
+{
+    if (entry != NULL)
+        entry->refs++;
+
+    return entry;
+}
+
+
+void texture_release(Texture_Entry *entry)
+{
+    if (entry == NULL)
+        return;
+
+    entry->refs--;
+
+    if (entry->refs <= 0)
+        texture_free(entry);
+}
+
+
+void texture_cache_quit()
+{   // Anything left here, other than the cache's own references, has leaked one. Clean it up anyway.
+    for (int i = 0; i < TEXTURE_CACHE_BUCKETS; i++)
+    {
+        Texture_Entry **current = &textureCache[i];
+
+        while (*current != NULL)
+        {
+            Texture_Entry *entry = *current;
+
+            if (entry->negative && entry->refs == 1)
+                texture_free(entry);
+            else
+                current = &entry->next;
+        }
+
+        while (textureCache[i] != NULL)
+        {
+            fprintf(stderr, "texture_cache: %s still has %d references.\n", textureCache[i]->path, textureCache[i]->refs);
+            texture_free(textureCache[i]);
+        }
+    }
+}
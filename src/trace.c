@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <sys/syscall.h>
+#include <time.h>
+
+// Chrome trace-event JSON, open it in chrome://tracing or ui.perfetto.dev.
+
+bool traceEnabled = false;
+
+static FILE      *traceFile  = NULL;
+static SDL_mutex *traceLock  = NULL;
+static bool       traceFirst = true;
+static struct timespec traceStart;
+
+
+static void trace_open(const char *path)
+{
+    traceFile = fopen(path, "w");
+
+    if (traceFile == NULL)
+    {
+        fprintf(stderr, "trace: couldn't open %s\n", path);
+        return;
+    }
+
+    // SDL mutexes work before SDL_Init, which is one of the things being traced.
+    traceLock = SDL_CreateMutex();
+    clock_gettime(CLOCK_MONOTONIC, &traceStart);
+
+    fputs("[\n", traceFile);
+
+    traceEnabled = true;
+    atexit(&trace_close);
+}
+
+
+void trace_args(int *argc, char *argv[])
+{   // Pulls --trace <file> out of argv before getopt ever sees it.
+    int out = 1;
+
+    for (int i = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < *argc)
+        {
+            trace_open(argv[++i]);
+            continue;
+        }
+
+        if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            trace_open(argv[i] + 8);
+            continue;
+        }
+
+        argv[out++] = argv[i];
+    }
+
+    argv[out] = NULL;
+    *argc = out;
+}
+
+
+static int utf8_length(const unsigned char *ch)
+{   // Length of the UTF-8 sequence at ch, 0 if it isn't a valid one. Overlong forms and surrogates are invalid.
+    int length;
+
+    if (*ch < 0x80)
+        return 1;
+    else if (*ch >= 0xC2 && *ch <= 0xDF)
+        length = 2;
+    else if (*ch >= 0xE0 && *ch <= 0xEF)
+        length = 3;
+    else if (*ch >= 0xF0 && *ch <= 0xF4)
+        length = 4;
+    else
+        return 0;
+
+    Uint32 code = *ch & (0x7F >> length);
+
+    for (int i = 1; i < length; i++)
+    {   // The terminator isn't a continuation byte, so this never reads past the end.
+        if ((ch[i] & 0xC0) != 0x80)
+            return 0;
+
+        code = (code << 6) | (ch[i] & 0x3F);
+    }
+
+    if ((length == 3 && code < 0x800) || (length == 4 && (code < 0x10000 || code > 0x10FFFF)) ||
+        (code >= 0xD800 && code <= 0xDFFF))
+        return 0;
+
+    return length;
+}
+
+
+static void trace_escape(FILE *file, const char *text)
+{   // Paths and text aren't always UTF-8, a byte that isn't part of a valid sequence is
+    // written as the Latin-1 character so viewers still accept the JSON.
+    const unsigned char *ch = (const unsigned char*)text;
+
+    while (*ch)
+    {
+        int length = utf8_length(ch);
+
+        if (length == 0)
+        {
+            fprintf(file, "\\u%04x", *ch);
+            ch++;
+        }
+        else if (*ch == '"' || *ch == '\\')
+        {
+            fprintf(file, "\\%c", *ch);
+            ch++;
+        }
+        else if (*ch < 0x20)
+        {
+            fprintf(file, "\\u%04x", *ch);
+            ch++;
+        }
+        else
+        {
+            fwrite(ch, 1, length, file);
+            ch += length;
+        }
+    }
+}
+
+
+void trace_event(char phase, const char *name, const char *arg)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double micros = (now.tv_sec - traceStart.tv_sec) * 1e6 + (now.tv_nsec - traceStart.tv_nsec) / 1e3;
+
+    SDL_LockMutex(traceLock);
+
+    if (traceFile != NULL)
+    {
+        fprintf(traceFile, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld",
+            traceFirst ? "" : ",\n", name, phase, micros, (int)getpid(), (long)syscall(SYS_gettid));
+
+        if (arg != NULL)
+        {
+            fputs(",\"args\":{\"name\":\"", traceFile);
+            trace_escape(traceFile, arg);
+            fputs("\"}", traceFile);
+        }
+
+        fputc('}', traceFile);
+        traceFirst = false;
+    }
+
+    SDL_UnlockMutex(traceLock);
+}
+
+
+void trace_close()
+{
+    if (traceFile == NULL)
+        return;
+
+    SDL_LockMutex(traceLock);
+
+    traceEnabled = false;
+
+    fputs("\n]\n", traceFile);
+    fclose(traceFile);
+    traceFile = NULL;
+
+    SDL_UnlockMutex(traceLock);
+}
@@ -2,15 +2,43 @@
 
 #include "sdl2imgshow.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+// Variable names are case-folded and interned, so scope lookups compare pointers.
+typedef struct _var_key
+{
+    struct _var_key *next;
+    Uint32 hash;
+    char   name[];
+} var_key;
+
 typedef struct _var_opt
 {
     struct _var_opt *next;
-    char *name;
+    const var_key *key;
     char *value;
 } var_opt;
 
+typedef struct _var_scope
+{
+    struct _var_scope *parent;
+    var_opt **buckets;
+    int bucketCount;
+    int count;
+} var_scope;
+
 
-var_opt *globalVars;
+static var_key **internTable = NULL;
+static int internBuckets = 0;
+static int internCount = 0;
+
+static var_scope *envScope = NULL;      // snapshot of the environment, taken once.
+static var_scope *varScope = NULL;      // innermost scope, set_var writes here.
+
+extern char **environ;
 
 
 void *ez_malloc(size_t size)
@@ -58,210 +86,703 @@ char *ez_strcatn(char *str1, const char *str2, size_t str2_len)
 
 
 // Simple INI reader function
-int ini_read(const char *filename, ini_callback callback, void *state)
-{
-    FILE *file = fopen(filename, "r");
-    if (file == NULL)
-    {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return 1;
-    }
+void ini_read_buffer(char *data, size_t size, ini_callback callback, void *state)
+{   // Splits `data` into key/value pairs in place, no line is ever copied.
+    // Every line must end with a newline, or data[size] must be writable.
+    char *next = data;
+    char *last = data + size;
 
-    char line[1024];
-    while (fgets(line, sizeof(line), file))
+    while (next < last)
     {
+        char *start = next;
+        char *end = (char*)memchr(start, '\n', last - start);
+
+        if (end == NULL)
+            end = last;
+
+        next = end + 1;
+
         // Trim leading and trailing whitespace
-        char *start = line;
-        while (isspace(*start))
+        while (start < end && isspace((unsigned char)*start))
             start++;
 
-        char *end = start + strlen(start) - 1;
-        while (end > start && isspace(*end))
+        while (end > start && isspace((unsigned char)end[-1]))
             end--;
-        *(end + 1) = '\0';
 
         // Ignore empty lines and comments
-        if (*start == '\0' || *start == '#')
+        if (start == end || *start == '#')
             continue;
 
         // Parse key-value pairs
-        char *delimiter = strchr(start, '=');
+        char *delimiter = (char*)memchr(start, '=', end - start);
 
-        if (delimiter != NULL)
-        {
-            *delimiter = '\0';
-            char *key = start;
-            char *value = delimiter + 1;
+        if (delimiter == NULL)
+            continue;
 
-            // Trim trailing whitespace from key
-            end = key + strlen(key) - 1;
-            while (end > key && isspace(*end)) end--;
-            *(end + 1) = '\0';
+        *delimiter = '\0';
+        *end = '\0';
 
-            // Trim leading whitespace from value
-            while (isspace(*value)) value++;
+        char *key = start;
+        char *value = delimiter + 1;
 
-            // Handle quoted text
-            if (*value == '"')
+        // Trim trailing whitespace from key
+        char *keyEnd = delimiter;
+        while (keyEnd > key && isspace((unsigned char)keyEnd[-1]))
+            keyEnd--;
+        *keyEnd = '\0';
+
+        // Trim leading whitespace from value
+        while (isspace((unsigned char)*value))
+            value++;
+
+        // Handle quoted text
+        if (*value == '"')
+        {
+            char *endQuote = strchr(value + 1, '"');
+            if (endQuote != NULL)
             {
-                char *endQuote = strchr(value + 1, '"');
-                if (endQuote != NULL)
-                {
-                    *endQuote = '\0';
-                    value++;
-                }
+                *endQuote = '\0';
+                value++;
             }
+        }
+
+        // Call the callback function
+        callback(state, key, value);
+    }
+}
+
 
-            // Call the callback function
-            callback(state, key, value);
+static char *ini_slurp(int fd, size_t *size)
+{   // For anything that can't be mapped, like pipes. Leaves a spare byte at the end.
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *data = (char*)ez_malloc(capacity);
+
+    for (;;)
+    {
+        if (length + 1 == capacity)
+        {
+            capacity *= 2;
+            data = (char*)realloc(data, capacity);
+
+            if (data == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory. :(\n");
+                exit(255);
+            }
         }
+
+        ssize_t got = read(fd, data + length, capacity - length - 1);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            break;
+
+        length += got;
+    }
+
+    *size = length;
+    return data;
+}
+
+
+int ini_read(const char *filename, ini_callback callback, void *state)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 1;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        size_t size;
+        char *data = ini_slurp(fd, &size);
+        close(fd);
+
+        ini_read_buffer(data, size, callback, state);
+
+        free(data);
+        return 0;
     }
 
-    fclose(file);
+    size_t size = info.st_size;
+
+    if (size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    // A private mapping lets us write the terminators without touching the file.
+    char *data = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Error reading file: %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // Only a last line without a newline has nowhere to put its terminator, so copy just that one.
+    size_t body = size;
+
+    while (body > 0 && data[body - 1] != '\n')
+        body--;
+
+    ini_read_buffer(data, body, callback, state);
+
+    if (body < size)
+    {
+        char *tail = ez_strcatn(NULL, data + body, size - body);
+        ini_read_buffer(tail, size - body, callback, state);
+        free(tail);
+    }
+
+    munmap(data, size);
     return 0;
 }
 
 
+// Every syscall spent finding and opening images and fonts, loader threads add to them too.
+// Lookups are counted apart, plenty of files are only ever looked up.
+static SDL_atomic_t assetLookups;
+static SDL_atomic_t assetMaps;
+static SDL_atomic_t assetMapSyscalls;      // open, fstat, mmap, close and munmap.
+
+
+bool file_stat(const char *filename, struct stat *info)
+{   // One metadata lookup, true for regular files only.
+    SDL_AtomicAdd(&assetLookups, 1);
+
+    return stat(filename, info) == 0 && S_ISREG(info->st_mode);
+}
+
+
 bool file_exists(const char *filename)
 {
-    FILE *file = fopen(filename, "r");
+    struct stat info;
+
+    return file_stat(filename, &info);
+}
+
+
+File_Map *file_map(const char *filename, bool populate)
+{   // open, fstat, mmap and close, nothing touches the file again until it's released.
+    // populate reads it all in straight away, for files that are decoded front to back.
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    SDL_AtomicAdd(&assetMapSyscalls, 1);
 
-    if (file != NULL)
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+
+    SDL_AtomicAdd(&assetMapSyscalls, 2);
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && info.st_size <= INT_MAX)
     {
-        fclose(file);
-        return true;
+        SDL_AtomicAdd(&assetMapSyscalls, 1);
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
     }
+    else
+    {
+        errno = EINVAL;
+    }
+
+    int error = errno;
+    close(fd);
+    errno = error;
+
+    if (data == MAP_FAILED)
+        return NULL;
+
+    SDL_AtomicAdd(&assetMaps, 1);
 
-    return false;
+    File_Map *map = (File_Map*)ez_malloc(sizeof(File_Map));
+
+    map->refs = 1;
+    map->data = data;
+    map->size = info.st_size;
+
+    return map;
 }
 
 
-void init_vars()
+File_Map *file_map_ref(File_Map *map)
 {
-    globalVars=NULL;
+    if (map != NULL)
+        map->refs++;
+
+    return map;
 }
 
 
-void quit_vars()
+void file_map_release(File_Map *map)
 {
-    var_opt *current = globalVars;
-    var_opt *next;
+    if (map == NULL || --map->refs > 0)
+        return;
 
-    while (current != NULL)
+    SDL_AtomicAdd(&assetMapSyscalls, 1);
+    munmap(map->data, map->size);
+
+    free(map);
+}
+
+
+void asset_io_stats()
+{
+    int lookups  = SDL_AtomicGet(&assetLookups);
+    int maps     = SDL_AtomicGet(&assetMaps);
+    int syscalls = SDL_AtomicGet(&assetMapSyscalls);
+
+    // Each file read costs the same whatever its size.
+    fprintf(stderr, "asset_io: %d lookups (1 stat each), %d files mapped (%d syscalls, %.1f per file)\n",
+        lookups, maps, syscalls, (maps > 0) ? (double)syscalls / maps : 0.0);
+}
+
+
+static Uint32 var_hash(const char *name)
+{   // FNV-1a over the lower case name.
+    Uint32 hash = 2166136261u;
+
+    while (*name)
     {
-        next = current->next;
+        hash ^= (Uint8)tolower((unsigned char)*name++);
+        hash *= 16777619u;
+    }
 
-        free(current->name);
-        free(current->value);
-        free(current);
+    return hash;
+}
+
+
+static void *var_buckets(int count)
+{
+    return ez_malloc(count * sizeof(void*));
+}
 
-        current = next;
+
+static const var_key *var_find_key(const char *name, Uint32 hash)
+{
+    if (internTable == NULL)
+        return NULL;
+
+    var_key *key = internTable[hash & (internBuckets - 1)];
+
+    while (key != NULL)
+    {
+        if (key->hash == hash && strcasecmp(key->name, name) == 0)
+            return key;
+
+        key = key->next;
     }
 
-    globalVars = NULL;
+    return NULL;
 }
 
 
-void set_var(const char *name, const char *value)
+static const var_key *var_intern(const char *name)
 {
-    var_opt *current = globalVars;
+    Uint32 hash = var_hash(name);
+    const var_key *found = var_find_key(name, hash);
 
-    fprintf(stderr, "%s = %s\n", name, value);
+    if (found != NULL)
+        return found;
 
-    while (current != NULL)
+    if (internCount >= internBuckets)
+    {   // Grow and rehash.
+        int newBuckets = (internBuckets == 0) ? 256 : internBuckets * 2;
+        var_key **newTable = (var_key**)var_buckets(newBuckets);
+
+        for (int i = 0; i < internBuckets; i++)
+        {
+            var_key *key = internTable[i];
+
+            while (key != NULL)
+            {
+                var_key *next = key->next;
+
+                key->next = newTable[key->hash & (newBuckets - 1)];
+                newTable[key->hash & (newBuckets - 1)] = key;
+
+                key = next;
+            }
+        }
+
+        free(internTable);
+        internTable = newTable;
+        internBuckets = newBuckets;
+    }
+
+    size_t length = strlen(name);
+    var_key *key = (var_key*)ez_malloc(sizeof(var_key) + length + 1);
+
+    key->hash = hash;
+
+    for (size_t i = 0; i < length; i++)
+        key->name[i] = tolower((unsigned char)name[i]);
+
+    key->next = internTable[hash & (internBuckets - 1)];
+    internTable[hash & (internBuckets - 1)] = key;
+    internCount++;
+
+    return key;
+}
+
+
+static var_scope *var_scope_create(var_scope *parent)
+{
+    var_scope *scope = (var_scope*)ez_malloc(sizeof(var_scope));
+
+    scope->parent = parent;
+    scope->bucketCount = 64;
+    scope->buckets = (var_opt**)var_buckets(scope->bucketCount);
+
+    return scope;
+}
+
+
+static void var_scope_free(var_scope *scope)
+{
+    for (int i = 0; i < scope->bucketCount; i++)
     {
-        if (strcasecmp(name, current->name) == 0)
+        var_opt *current = scope->buckets[i];
+
+        while (current != NULL)
         {
+            var_opt *next = current->next;
+
             free(current->value);
-            current->value = strdup(value);
-            return;
+            free(current);
+
+            current = next;
         }
+    }
+
+    free(scope->buckets);
+    free(scope);
+}
+
+
+static var_opt *var_scope_find(const var_scope *scope, const var_key *key)
+{
+    var_opt *current = scope->buckets[key->hash & (scope->bucketCount - 1)];
+
+    while (current != NULL)
+    {
+        if (current->key == key)
+            return current;
 
         current = current->next;
     }
 
-    current = (var_opt*)ez_malloc(sizeof(var_opt));
-    current->next = globalVars;
-    globalVars = current;
+    return NULL;
+}
+
+
+static void var_scope_set(var_scope *scope, const var_key *key, const char *value)
+{
+    var_opt *current = var_scope_find(scope, key);
 
-    current->name  = strdup(name);
+    if (current != NULL)
+    {
+        free(current->value);
+        current->value = strdup(value);
+        return;
+    }
+
+    if (scope->count >= scope->bucketCount)
+    {   // Grow and rehash.
+        int newCount = scope->bucketCount * 2;
+        var_opt **newBuckets = (var_opt**)var_buckets(newCount);
+
+        for (int i = 0; i < scope->bucketCount; i++)
+        {
+            var_opt *item = scope->buckets[i];
+
+            while (item != NULL)
+            {
+                var_opt *next = item->next;
+
+                item->next = newBuckets[item->key->hash & (newCount - 1)];
+                newBuckets[item->key->hash & (newCount - 1)] = item;
+
+                item = next;
+            }
+        }
+
+        free(scope->buckets);
+        scope->buckets = newBuckets;
+        scope->bucketCount = newCount;
+    }
+
+    current = (var_opt*)ez_malloc(sizeof(var_opt));
+    current->key   = key;
     current->value = strdup(value);
+
+    current->next = scope->buckets[key->hash & (scope->bucketCount - 1)];
+    scope->buckets[key->hash & (scope->bucketCount - 1)] = current;
+    scope->count++;
+}
+
+
+void init_vars()
+{
+    // Snapshot the environment so lookups never have to call getenv.
+    envScope = var_scope_create(NULL);
+
+    for (char **env = environ; env != NULL && *env != NULL; env++)
+    {
+        const char *delimiter = strchr(*env, '=');
+
+        if (delimiter == NULL)
+            continue;
+
+        char *name = ez_strcatn(NULL, *env, delimiter - *env);
+        var_scope_set(envScope, var_intern(name), delimiter + 1);
+        free(name);
+    }
+
+    varScope = var_scope_create(envScope);
+}
+
+
+void quit_vars()
+{
+    while (varScope != NULL)
+    {
+        var_scope *parent = varScope->parent;
+        var_scope_free(varScope);
+        varScope = parent;
+    }
+
+    envScope = NULL;
+
+    for (int i = 0; i < internBuckets; i++)
+    {
+        var_key *key = internTable[i];
+
+        while (key != NULL)
+        {
+            var_key *next = key->next;
+            free(key);
+            key = next;
+        }
+    }
+
+    free(internTable);
+    internTable = NULL;
+    internBuckets = 0;
+    internCount = 0;
+}
+
+
+void push_vars()
+{   // Variables set from now on are thrown away by the matching pop_vars.
+    varScope = var_scope_create(varScope);
+}
+
+
+void pop_vars()
+{
+    if (varScope == NULL || varScope->parent == envScope)
+    {
+        fprintf(stderr, "Error: pop_vars without push_vars.\n");
+        return;
+    }
+
+    var_scope *parent = varScope->parent;
+    var_scope_free(varScope);
+    varScope = parent;
+}
+
+
+void set_var(const char *name, const char *value)
+{
+    fprintf(stderr, "%s = %s\n", name, value);
+
+    var_scope_set(varScope, var_intern(name), value);
 }
 
 
 const char *get_var(const char *name)
 {
-    var_opt *current = globalVars;
+    // A name that was never interned can't be set anywhere.
+    const var_key *key = var_find_key(name, var_hash(name));
 
-    while (current != NULL)
+    if (key == NULL)
+        return NULL;
+
+    for (const var_scope *scope = varScope; scope != NULL; scope = scope->parent)
     {
-        if (strcasecmp(current->name, name) == 0)
+        var_opt *current = var_scope_find(scope, key);
+
+        if (current != NULL)
             return current->value;
+    }
 
-        current = current->next;
+    return NULL;
+}
+
+
+static const char *var_lookup(const var_key *key)
+{
+    for (const var_scope *scope = varScope; scope != NULL; scope = scope->parent)
+    {
+        var_opt *current = var_scope_find(scope, key);
+
+        if (current != NULL)
+            return current->value;
     }
 
-    return getenv(name);
+    return NULL;
 }
 
 
-char *sub_vars(const char *input)
-{   // substitute vars enclosed in {{}}.
-    char *output = NULL;
+Template *template_compile(const char *input)
+{   // Split `input` into literal text and {{variable}} references.
+    Template *tmpl = (Template*)ez_malloc(sizeof(Template));
+    int capacity = 0;
 
-    const char *last = input;
-    const char *start = strstr(last, "{{");
-    const char *end = NULL;
+    tmpl->source = strdup(input);
 
-    fprintf(stderr, "> \"%s\"\n", input);
+    const char *last = tmpl->source;
 
-    while (start != NULL)
+    while (*last)
     {
-        if (start > last)
-        {   // copy any text we have just skipped over.
-            output = ez_strcatn(output, last, start - last);
+        const char *start = strstr(last, "{{");
+        const char *end = (start != NULL) ? strstr(start + 2, "}}") : NULL;
+
+        if (tmpl->count + 2 > capacity)
+        {
+            capacity = (capacity == 0) ? 4 : capacity * 2;
+            tmpl->segments = (Template_Segment*)realloc(tmpl->segments, capacity * sizeof(Template_Segment));
+
+            if (tmpl->segments == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory. :(\n");
+                exit(255);
+            }
         }
 
-        end = strstr(start, "}}");
+        if (start == NULL || end == NULL)
+        {   // no more variables (or no closing terminator), the rest is literal.
+            Template_Segment *segment = &tmpl->segments[tmpl->count++];
 
-        if (end == NULL)
-        {   // no closing terminator, copy everything from `start` forwards.
-            size_t rest = strlen(start);
-            output = ez_strcatn(output, start, rest);
-            last = start + rest;
+            segment->text = last;
+            segment->length = strlen(last);
+            segment->key = NULL;
             break;
         }
 
-        start += 2;
+        if (start > last)
+        {
+            Template_Segment *segment = &tmpl->segments[tmpl->count++];
+
+            segment->text = last;
+            segment->length = start - last;
+            segment->key = NULL;
+        }
+
+        // Variable names are interned up front, so evaluating is just scope lookups.
+        Template_Segment *segment = &tmpl->segments[tmpl->count++];
+        char *var_name = ez_strcatn(NULL, start + 2, end - (start + 2));
+
+        segment->text = start + 2;
+        segment->length = end - (start + 2);
+        segment->key = var_intern(var_name);
+
+        free(var_name);
+
+        last = end + 2;
+    }
+
+    return tmpl;
+}
+
+
+char *template_eval(const Template *tmpl)
+{   // Size the output first, then fill it in with a single allocation.
+    size_t length = 0;
+
+    for (int i = 0; i < tmpl->count; i++)
+    {
+        const Template_Segment *segment = &tmpl->segments[i];
+        const char *value = (segment->key != NULL) ? var_lookup(segment->key) : NULL;
 
-        // extract the variable name, and the variable value if it exists.
-        char *var_name = ez_strcatn(NULL, start, end - start);
-        const char* var_value = get_var(var_name);
+        length += (value != NULL) ? strlen(value) : segment->length;
+    }
 
-        fprintf(stderr, "= \"%s\" = ", var_name);
+    char *output = (char*)malloc(length + 1);
 
-        if (var_value != NULL)
-        {   // concatenate the variable value
-            fprintf(stderr, "\"%s\"\n", var_value);
-            output = ez_strcatn(output, var_value, strlen(var_value));
+    if (output == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory. :(\n");
+        exit(255);
+    }
+
+    char *current = output;
+
+    for (int i = 0; i < tmpl->count; i++)
+    {
+        const Template_Segment *segment = &tmpl->segments[i];
+        const char *value = (segment->key != NULL) ? var_lookup(segment->key) : NULL;
+
+        // an unknown variable is left as its name because what else am i supposed to do?
+        if (value != NULL)
+        {
+            size_t value_len = strlen(value);
+            memcpy(current, value, value_len);
+            current += value_len;
         }
         else
-        {   // concatenate the variable name because what else am i supposed to do?
-            fprintf(stderr, "(null)\n");
-            output = ez_strcatn(output, var_name, strlen(var_name));
+        {
+            memcpy(current, segment->text, segment->length);
+            current += segment->length;
         }
+    }
 
-        free(var_name);
+    *current = '\0';
 
-        end += 2;
+    return output;
+}
 
-        last = end;
-        start = strstr(end, "{{");
-    }
 
-    if (last[0] != 0)
-    {   // copy anything else left.
-        output = ez_strcatn(output, last, strlen(last));
+void template_free(Template *tmpl)
+{
+    if (tmpl == NULL)
+        return;
+
+    free(tmpl->segments);
+    free(tmpl->source);
+    free(tmpl);
+}
+
+
+char *sub_vars(const char *input)
+{   // substitute vars enclosed in {{}}.
+    fprintf(stderr, "> \"%s\"\n", input);
+
+    char *output;
+
+    if (strstr(input, "{{") == NULL)
+    {   // nothing to substitute.
+        output = strdup(input);
+    }
+    else
+    {
+        Template *tmpl = template_compile(input);
+        output = template_eval(tmpl);
+        template_free(tmpl);
     }
 
     fprintf(stderr, "< \"%s\"\n", output);
@@ -336,12 +857,8 @@ int get_text_align(const char *text_align)
 }
 
 
-void calculate_texture_size(SDL_Texture *imageTexture, SDL_Rect *textureRect, int size)
+void calculate_texture_size(int originalWidth, int originalHeight, SDL_Rect *textureRect, int size, const SDL_Rect *margins)
 {
-    // Get the original width and height of the texture
-    int originalWidth, originalHeight;
-    SDL_QueryTexture(imageTexture, NULL, NULL, &originalWidth, &originalHeight);
-
     // Set initial width and height
     int textureWidth = originalWidth;
     int textureHeight = originalHeight;
@@ -351,27 +868,27 @@ void calculate_texture_size(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
     {
     case SIZE_FIT:
         // Fit the texture within screen dimensions while considering margins
-        if (originalWidth > screenWidth - globalMargins.x - globalMargins.w)
+        if (originalWidth > screenWidth - margins->x - margins->w)
         {
-            textureWidth = screenWidth - globalMargins.x - globalMargins.w;
+            textureWidth = screenWidth - margins->x - margins->w;
             textureHeight = (originalHeight * textureWidth) / originalWidth;
         }
-        if (textureHeight > screenHeight - globalMargins.y - globalMargins.h)
+        if (textureHeight > screenHeight - margins->y - margins->h)
         {
-            textureHeight = screenHeight - globalMargins.y - globalMargins.h;
+            textureHeight = screenHeight - margins->y - margins->h;
             textureWidth = (originalWidth * textureHeight) / originalHeight;
         }
         break;
 
     case SIZE_VERTICAL:
         // Keep original width, adjust height to fit vertically within screen dimensions
-        textureHeight = screenHeight - globalMargins.y - globalMargins.h;
+        textureHeight = screenHeight - margins->y - margins->h;
         textureWidth = (originalWidth * textureHeight) / originalHeight;
         break;
 
     case SIZE_HORIZONTAL:
         // Keep original height, adjust width to fit horizontally within screen dimensions
-        textureWidth = screenWidth - globalMargins.x - globalMargins.w;
+        textureWidth = screenWidth - margins->x - margins->w;
         textureHeight = (originalHeight * textureWidth) / originalWidth;
         break;
 
@@ -381,8 +898,8 @@ void calculate_texture_size(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
 
     case SIZE_STRETCH:
         // Stretch the texture to fit screen dimensions
-        textureWidth = screenWidth - globalMargins.x - globalMargins.w;
-        textureHeight = screenHeight - globalMargins.y - globalMargins.h;
+        textureWidth = screenWidth - margins->x - margins->w;
+        textureHeight = screenHeight - margins->y - margins->h;
         break;
 
     default:
@@ -396,17 +913,15 @@ void calculate_texture_size(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
 }
 
 
-void calculate_texture_rect(SDL_Texture *imageTexture, SDL_Rect *textureRect, int position)
+void calculate_texture_rect(SDL_Rect *textureRect, int position, const SDL_Rect *margins)
 {
-    UNUSED(imageTexture);
-
     // Calculate X position based on the position enum
     switch (position)
     {
     case POS_TOPLEFT:
     case POS_MIDLEFT:
     case POS_BOTTOMLEFT:
-        textureRect->x = globalMargins.x;
+        textureRect->x = margins->x;
         break;
 
     case POS_TOPCENTER:
@@ -418,11 +933,11 @@ void calculate_texture_rect(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
     case POS_TOPRIGHT:
     case POS_MIDRIGHT:
     case POS_BOTTOMRIGHT:
-        textureRect->x = screenWidth - textureRect->w - globalMargins.w;
+        textureRect->x = screenWidth - textureRect->w - margins->w;
         break;
 
     default:
-        textureRect->x = globalMargins.x; // Default to left if position not specified
+        textureRect->x = margins->x; // Default to left if position not specified
         break;
     }
 
@@ -432,7 +947,7 @@ void calculate_texture_rect(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
     case POS_TOPLEFT:
     case POS_TOPCENTER:
     case POS_TOPRIGHT:
-        textureRect->y = globalMargins.y;
+        textureRect->y = margins->y;
         break;
 
     case POS_MIDLEFT:
@@ -444,11 +959,11 @@ void calculate_texture_rect(SDL_Texture *imageTexture, SDL_Rect *textureRect, in
     case POS_BOTTOMLEFT:
     case POS_BOTTOMCENTER:
     case POS_BOTTOMRIGHT:
-        textureRect->y = screenHeight - textureRect->h - globalMargins.h;
+        textureRect->y = screenHeight - textureRect->h - margins->h;
         break;
 
     default:
-        textureRect->y = globalMargins.y; // Default to top if position not specified
+        textureRect->y = margins->y; // Default to top if position not specified
         break;
     }
 }
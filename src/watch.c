@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: MIT
+
+#include "sdl2imgshow.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+
+#define PROCESS_WATCH_INTERVAL 100
+#define PROCESS_WATCH_RESCAN   10      // re-read every process every N ticks, catches exec().
+#define PROCESS_COMM_LEN       16
+
+Uint32 processWatchEvent = 0;
+bool   processWatchExact = false;
+
+static char **watchNames = NULL;
+static int    watchNameCount = 0;
+
+static SDL_TimerID watchTimer = 0;
+static SDL_mutex  *watchLock  = NULL;
+static bool        watchStopped = false;
+
+// Sorted pids that have already been checked and didn't match.
+static pid_t *watchPids = NULL;
+static int    watchPidCount = 0;
+static int    watchTicks = 0;
+
+
+static int pid_compare(const void *a, const void *b)
+{
+    pid_t pa = *(const pid_t*)a;
+    pid_t pb = *(const pid_t*)b;
+
+    return (pa > pb) - (pa < pb);
+}
+
+
+static bool process_name_matches(const char *comm)
+{
+    for (int i = 0; i < watchNameCount; i++)
+    {
+        if (processWatchExact)
+        {   // comm is truncated by the kernel, so only compare what it keeps.
+            if (strncmp(comm, watchNames[i], PROCESS_COMM_LEN - 1) == 0)
+                return true;
+        }
+        else if (strstr(comm, watchNames[i]) != NULL)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static bool process_check(pid_t pid)
+{
+    char path[64];
+    char comm[PROCESS_COMM_LEN + 1];
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    ssize_t length = read(fd, comm, sizeof(comm) - 1);
+    close(fd);
+
+    if (length <= 0)
+        return false;
+
+    comm[length] = '\0';
+
+    if (comm[length - 1] == '\n')
+        comm[length - 1] = '\0';
+
+    return process_name_matches(comm);
+}
+
+
+static bool process_scan(bool rescan)
+{   // Only processes that appeared since the last scan get their name read.
+    DIR *dir = opendir("/proc");
+
+    if (dir == NULL)
+        return false;
+
+    pid_t self = getpid();
+    pid_t *seen = NULL;
+    int seenCount = 0;
+    int seenSize = 0;
+    bool found = false;
+    struct dirent *dirent;
+
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        if (dirent->d_name[0] < '0' || dirent->d_name[0] > '9')
+            continue;
+
+        pid_t pid = (pid_t)atoi(dirent->d_name);
+
+        if (pid == self)
+            continue;
+
+        if (rescan || bsearch(&pid, watchPids, watchPidCount, sizeof(pid_t), &pid_compare) == NULL)
+        {
+            if (process_check(pid))
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if (seenCount == seenSize)
+        {
+            seenSize = (seenSize == 0) ? 256 : seenSize * 2;
+            seen = (pid_t*)realloc(seen, seenSize * sizeof(pid_t));
+
+            if (seen == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory. :(\n");
+                exit(255);
+            }
+        }
+
+        seen[seenCount++] = pid;
+    }
+
+    closedir(dir);
+
+    qsort(seen, seenCount, sizeof(pid_t), &pid_compare);
+
+    free(watchPids);
+    watchPids = seen;
+    watchPidCount = seenCount;
+
+    return found;
+}
+
+
+static Uint32 process_watch_tick(Uint32 interval, void *param)
+{
+    UNUSED(param);
+
+    SDL_LockMutex(watchLock);
+
+    if (watchStopped)
+    {
+        SDL_UnlockMutex(watchLock);
+        return 0;
+    }
+
+    bool found = process_scan((watchTicks++ % PROCESS_WATCH_RESCAN) == 0);
+
+    if (found)
+    {   // Wake up the main loop, there is nothing left to watch for.
+        SDL_Event event;
+        memset(&event, '\0', sizeof(event));
+        event.type = processWatchEvent;
+        SDL_PushEvent(&event);
+
+        watchStopped = true;
+        interval = 0;
+    }
+
+    SDL_UnlockMutex(watchLock);
+
+    return interval;
+}
+
+
+void process_watch_add(const char *name)
+{
+    watchNames = (char**)realloc(watchNames, (watchNameCount + 1) * sizeof(char*));
+
+    if (watchNames == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory. :(\n");
+        exit(255);
+    }
+
+    watchNames[watchNameCount++] = strdup(name);
+}
+
+
+bool process_watch_start()
+{
+    if (watchNameCount == 0)
+        return false;
+
+    processWatchEvent = SDL_RegisterEvents(1);
+
+    // Never destroyed, the timer thread may still be waiting on it while we quit.
+    if (watchLock == NULL)
+        watchLock = SDL_CreateMutex();
+
+    watchStopped = false;
+    watchTicks = 0;
+
+    watchTimer = SDL_AddTimer(PROCESS_WATCH_INTERVAL, &process_watch_tick, NULL);
+
+    if (watchTimer == 0)
+    {
+        fprintf(stderr, "SDL_AddTimer Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+
+void process_watch_quit()
+{
+    if (watchTimer != 0)
+    {
+        SDL_LockMutex(watchLock);
+        watchStopped = true;
+        SDL_UnlockMutex(watchLock);
+
+        SDL_RemoveTimer(watchTimer);
+        watchTimer = 0;
+    }
+
+    for (int i = 0; i < watchNameCount; i++)
+        free(watchNames[i]);
+
+    free(watchNames);
+    free(watchPids);
+
+    watchNames = NULL;
+    watchNameCount = 0;
+    watchPids = NULL;
+    watchPidCount = 0;
+}